@@ -31,8 +31,8 @@
 
 namespace astyle {
 
-// this must be global
-static int g_preprocessorCppExternCBracket;
+// this must be global, per thread so several files can be formatted at once
+static thread_local int g_preprocessorCppExternCBracket;
 
 /**
  * ASBeautifier's constructor
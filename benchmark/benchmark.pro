@@ -0,0 +1,51 @@
+DESTDIR = ../build
+
+QT += core gui widgets svg xml network concurrent
+CONFIG += c++14 console
+CONFIG -= app_bundle
+
+TARGET = codemodel-benchmark
+TEMPLATE = app
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+IDE_DIR = $$PWD/../ide
+
+INCLUDEPATH += $$IDE_DIR $$PWD/../3rdpart
+
+SOURCES += \
+    main.cpp \
+    projectgenerator.cpp \
+    $$IDE_DIR/appconfig.cpp \
+    $$IDE_DIR/buildmanager.cpp \
+    $$IDE_DIR/childprocess.cpp \
+    $$IDE_DIR/clangautocompletionprovider.cpp \
+    $$IDE_DIR/compilecommanddatabase.cpp \
+    $$IDE_DIR/icodemodelprovider.cpp \
+    $$IDE_DIR/includegraph.cpp \
+    $$IDE_DIR/processmanager.cpp \
+    $$IDE_DIR/projectmanager.cpp \
+    $$IDE_DIR/regexhtmltranslator.cpp \
+    $$IDE_DIR/semantickeywords.cpp \
+    $$IDE_DIR/textmessagebrocker.cpp \
+    $$IDE_DIR/toolchainregistry.cpp \
+    $$IDE_DIR/usageindex.cpp \
+    $$IDE_DIR/wordindex.cpp
+
+HEADERS += \
+    projectgenerator.h \
+    $$IDE_DIR/appconfig.h \
+    $$IDE_DIR/buildmanager.h \
+    $$IDE_DIR/childprocess.h \
+    $$IDE_DIR/clangautocompletionprovider.h \
+    $$IDE_DIR/compilecommanddatabase.h \
+    $$IDE_DIR/icodemodelprovider.h \
+    $$IDE_DIR/includegraph.h \
+    $$IDE_DIR/processmanager.h \
+    $$IDE_DIR/projectmanager.h \
+    $$IDE_DIR/regexhtmltranslator.h \
+    $$IDE_DIR/semantickeywords.h \
+    $$IDE_DIR/textmessagebrocker.h \
+    $$IDE_DIR/toolchainregistry.h \
+    $$IDE_DIR/usageindex.h \
+    $$IDE_DIR/wordindex.h
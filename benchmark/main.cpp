@@ -0,0 +1,291 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "appconfig.h"
+#include "clangautocompletionprovider.h"
+#include "processmanager.h"
+#include "projectgenerator.h"
+#include "projectmanager.h"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QListView>
+#include <QStandardPaths>
+#include <QSysInfo>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QTimer>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+
+static bool verbose = false;
+
+static void messageFilter(QtMsgType type, const QMessageLogContext &context, const QString &msg)
+{
+    Q_UNUSED(context)
+    if (type == QtDebugMsg && !verbose)
+        return;
+    fprintf(stderr, "%s\n", qPrintable(msg));
+}
+
+static QJsonObject stats(QVector<double> samples)
+{
+    if (samples.isEmpty())
+        return QJsonObject{ { "count", 0 } };
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (auto s: samples)
+        sum += s;
+    auto at = [&samples](double q) { return samples.at(qMin(samples.size() - 1, int(q * samples.size()))); };
+    return QJsonObject{
+        { "count", samples.size() },
+        { "min", samples.first() },
+        { "median", at(0.5) },
+        { "p95", at(0.95) },
+        { "max", samples.last() },
+        { "mean", sum / samples.size() },
+    };
+}
+
+static double elapsedMs(const QElapsedTimer& t) { return t.nsecsElapsed() / 1e6; }
+static double elapsedUs(const QElapsedTimer& t) { return t.nsecsElapsed() / 1e3; }
+
+// Runs the event loop until done() is true or the timeout expires
+template<typename F>
+static bool waitUntil(F done, int timeoutMs)
+{
+    QElapsedTimer t;
+    t.start();
+    while (!done()) {
+        if (t.elapsed() > timeoutMs)
+            return false;
+        QEventLoop loop;
+        QTimer::singleShot(5, &loop, &QEventLoop::quit);
+        loop.exec();
+    }
+    return true;
+}
+
+// A partial report would compare as a real one, fail the run instead
+static int timedOut(const char *phase)
+{
+    fprintf(stderr, "timed out waiting for %s\n", phase);
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QCoreApplication::setApplicationName("Embedded IDE codemodel benchmark");
+    QApplication app(argc, argv);
+    qInstallMessageHandler(messageFilter);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Times the code model on a generated embedded project");
+    parser.addHelpOption();
+    QCommandLineOption sourcesOpt("sources", "Number of generated sources", "N", "200");
+    QCommandLineOption headersOpt("headers", "Number of generated HAL headers", "M", "50");
+    QCommandLineOption macrosOpt("macros", "Macros per header", "K", "40");
+    QCommandLineOption functionsOpt("functions", "Functions per source", "F", "10");
+    QCommandLineOption seedOpt("seed", "Generator seed", "S", "1");
+    QCommandLineOption iterationsOpt("iterations", "Repetitions of the project index", "R", "3");
+    QCommandLineOption lookupsOpt("lookups", "Number of referenceOf queries", "Q", "500");
+    QCommandLineOption completionsOpt("completions", "Number of completion requests", "C", "20");
+    QCommandLineOption outputOpt({ "o", "output" }, "Write the JSON report here instead of stdout", "file");
+    QCommandLineOption labelOpt("label", "Free text stored in the report, like a revision", "text");
+    QCommandLineOption workdirOpt("workdir", "Generate the project here and keep it", "dir");
+    QCommandLineOption verboseOpt("verbose", "Show debug output of the code model");
+    parser.addOptions({ sourcesOpt, headersOpt, macrosOpt, functionsOpt, seedOpt, iterationsOpt,
+                        lookupsOpt, completionsOpt, outputOpt, labelOpt, workdirOpt, verboseOpt });
+    parser.process(app);
+    verbose = parser.isSet(verboseOpt);
+
+    QTemporaryDir tmp;
+    auto workdir = parser.isSet(workdirOpt)? parser.value(workdirOpt) : tmp.path();
+    QDir(workdir).mkpath("home");
+    QDir(workdir).mkpath("project");
+    // Keep configuration and caches away from the user workspace
+    qputenv("HOME", QDir(workdir).absoluteFilePath("home").toLocal8Bit());
+    AppConfig::instance().load();
+
+    ProjectGenerator::Options options;
+    options.sources = parser.value(sourcesOpt).toInt();
+    options.headers = parser.value(headersOpt).toInt();
+    options.macrosPerHeader = parser.value(macrosOpt).toInt();
+    options.functionsPerSource = parser.value(functionsOpt).toInt();
+    options.seed = parser.value(seedOpt).toUInt();
+    auto project = ProjectGenerator::generate(QDir(workdir).absoluteFilePath("project"), options);
+
+    QListView view;
+    ProcessManager pman;
+    ProjectManager projectManager(&view, &pman);
+    auto provider = new ClangAutocompletionProvider(&projectManager, &projectManager);
+    projectManager.setCodeModelProvider(provider);
+    QJsonObject results;
+
+    // Whole open, including make discovery and the delay ProjectManager adds before indexing
+    bool indexed = false;
+    bool usagesIndexed = false;
+    QElapsedTimer openTimer;
+    auto indexConn = QObject::connect(&projectManager, &ProjectManager::indexFinished, [&]() {
+        if (!indexed)
+            results.insert("open_project_ms", elapsedMs(openTimer));
+        indexed = true;
+    });
+    auto usageConn = QObject::connect(provider, &ClangAutocompletionProvider::usageIndexFinished, [&]() {
+        if (!usagesIndexed)
+            results.insert("usage_index_ms", elapsedMs(openTimer));
+        usagesIndexed = true;
+    });
+    openTimer.start();
+    projectManager.openProject(project.makefile);
+    constexpr int INDEX_TIMEOUT = 10 * 60 * 1000;
+    if (!waitUntil([&]() { return indexed && usagesIndexed; }, INDEX_TIMEOUT))
+        return timedOut("open project");
+    QObject::disconnect(indexConn);
+    QObject::disconnect(usageConn);
+
+    QVector<double> ingestion;
+    for (int i = 0; i < parser.value(iterationsOpt).toInt(); i++) {
+        std::atomic<qint64> doneAt{ -1 };
+        usagesIndexed = false;
+        auto conn = QObject::connect(provider, &ClangAutocompletionProvider::usageIndexFinished, [&]() { usagesIndexed = true; });
+        QElapsedTimer t;
+        t.start();
+        provider->startIndexingProject(projectManager.projectPath(), [&doneAt, &t]() { doneAt = t.nsecsElapsed(); });
+        if (!waitUntil([&]() { return doneAt >= 0 && usagesIndexed; }, INDEX_TIMEOUT))
+            return timedOut("ctags ingestion");
+        QObject::disconnect(conn);
+        if (doneAt >= 0)
+            ingestion.append(doneAt / 1e6);
+    }
+    results.insert("ctags_ingestion_ms", stats(ingestion));
+
+    auto symbols = project.functions + project.macros;
+    QVector<double> lookups;
+    qint64 hits = 0;
+    for (int i = 0; i < parser.value(lookupsOpt).toInt() && !symbols.isEmpty(); i++) {
+        const auto& name = symbols.at(int((quint64(i) * 7919) % quint64(symbols.size())));
+        QElapsedTimer t;
+        t.start();
+        // Line texts are read on a worker, time until the callback runs
+        QEventLoop loop;
+        bool done = false;
+        provider->referenceOf(name, [&hits, &done, &loop](const ICodeModelProvider::FileReferenceList& refs) {
+            hits += refs.size();
+            done = true;
+            loop.quit();
+        });
+        if (!done)
+            loop.exec();
+        lookups.append(elapsedUs(t));
+    }
+    results.insert("reference_of_us", stats(lookups));
+    results.insert("reference_of_hits", double(hits));
+
+    QVector<double> fileSymbols;
+    for (const auto& path: project.sources + project.headers) {
+        QElapsedTimer t;
+        t.start();
+        provider->requestSymbolForFile(path, [](const ICodeModelProvider::SymbolSetMap&) {});
+        fileSymbols.append(elapsedUs(t));
+    }
+    results.insert("request_symbol_for_file_us", stats(fileSymbols));
+
+    QVector<double> cold;
+    QVector<double> cached;
+    qint64 completionItems = 0;
+    const auto points = project.completionPoints.mid(0, parser.value(completionsOpt).toInt());
+    int revision = 0;
+    for (const auto& point: points) {
+        QFile f(point.path);
+        f.open(QFile::ReadOnly);
+        auto unsaved = f.readAll();
+        ICodeModelProvider::FileReference ref{ point.path, point.line, point.column, QString() };
+        bool done = false;
+        QElapsedTimer t;
+        t.start();
+        provider->completionAt(ref, point.prefix, ++revision, unsaved, [&](const QStringList& list) {
+            cold.append(elapsedMs(t));
+            completionItems += list.size();
+            done = true;
+        });
+        constexpr int COMPLETION_TIMEOUT = 60 * 1000;
+        if (!waitUntil([&done]() { return done; }, COMPLETION_TIMEOUT))
+            return timedOut("completion");
+        // Same word, one more character typed: served from the cache
+        t.restart();
+        provider->completionAt(ref, point.word.left(point.prefix.size() + 1), revision, unsaved, [&](const QStringList&) {
+            cached.append(elapsedUs(t));
+        });
+    }
+    results.insert("completion_cold_ms", stats(cold));
+    results.insert("completion_cached_us", stats(cached));
+    results.insert("completion_items", double(completionItems));
+
+    auto tool = [](const char *name) { return !QStandardPaths::findExecutable(name).isEmpty(); };
+    QJsonObject report{
+        { "benchmark", "codemodel" },
+        { "label", parser.value(labelOpt) },
+        { "timestamp", QDateTime::currentDateTimeUtc().toString(Qt::ISODate) },
+        { "host", QJsonObject{
+              { "os", QSysInfo::prettyProductName() },
+              { "cpu", QSysInfo::currentCpuArchitecture() },
+              { "threads", QThread::idealThreadCount() },
+              { "qt", qVersion() },
+          } },
+        { "tools", QJsonObject{
+              { "universal-ctags", tool("universal-ctags") },
+              { "clang", tool("clang") },
+              { "make", tool("make") },
+          } },
+        { "project", QJsonObject{
+              { "sources", options.sources },
+              { "headers", options.headers },
+              { "macrosPerHeader", options.macrosPerHeader },
+              { "functionsPerSource", options.functionsPerSource },
+              { "seed", double(options.seed) },
+              { "bytes", double(project.bytes) },
+          } },
+        { "results", results },
+    };
+
+    projectManager.closeProject();
+    auto json = QJsonDocument(report).toJson();
+    if (parser.isSet(outputOpt)) {
+        QFile out(parser.value(outputOpt));
+        if (!out.open(QFile::WriteOnly)) {
+            fprintf(stderr, "cannot write %s: %s\n", qPrintable(out.fileName()), qPrintable(out.errorString()));
+            return 1;
+        }
+        out.write(json);
+    } else {
+        fwrite(json.constData(), 1, size_t(json.size()), stdout);
+    }
+    return 0;
+}
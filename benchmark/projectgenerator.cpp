@@ -0,0 +1,184 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "projectgenerator.h"
+
+#include <QDir>
+#include <QFile>
+
+#include <random>
+
+static const char MAKEFILE[] =
+        "CC ?= gcc\n"
+        "CFLAGS ?= -O2 -Wall\n"
+        "CFLAGS += -Iinc -DUSE_HAL_DRIVER -DSTM32F407xx -std=c99\n"
+        "\n"
+        "SRC := $(wildcard src/*.c)\n"
+        "OBJ := $(SRC:src/%.c=build/%.o)\n"
+        "\n"
+        "all: build/firmware.elf\n"
+        "\n"
+        "build/firmware.elf: $(OBJ)\n"
+        "\t$(CC) $(CFLAGS) -o $@ $^\n"
+        "\n"
+        "build/%.o: src/%.c\n"
+        "\t@mkdir -p build\n"
+        "\t$(CC) $(CFLAGS) -c $< -o $@\n"
+        "\n"
+        "clean:\n"
+        "\trm -rf build\n"
+        "\n"
+        ".PHONY: all clean\n";
+
+static const char HAL_CONF[] =
+        "#ifndef HAL_CONF_H\n"
+        "#define HAL_CONF_H\n"
+        "\n"
+        "#include <stdint.h>\n"
+        "\n"
+        "#define HAL_MODULE_ENABLED\n"
+        "#define HSE_VALUE ((uint32_t)8000000U)\n"
+        "#define TICK_INT_PRIORITY ((uint32_t)0x0FU)\n"
+        "\n"
+        "#endif /* HAL_CONF_H */\n";
+
+static void writeFile(const QString& path, const QByteArray& data, qint64 *bytes)
+{
+    QFile f(path);
+    if (f.open(QFile::WriteOnly))
+        *bytes += f.write(data);
+}
+
+static QByteArray joinLines(const QStringList& lines)
+{
+    return (lines.join('\n') + '\n').toUtf8();
+}
+
+ProjectGenerator::Project ProjectGenerator::generate(const QString &directory, const Options &options)
+{
+    Project project;
+    QDir root(directory);
+    root.mkpath("inc");
+    root.mkpath("src");
+    std::mt19937 rng(options.seed);
+    auto pick = [&rng](int n) { return static_cast<int>(rng() % static_cast<quint32>(qMax(n, 1))); };
+
+    project.makefile = root.absoluteFilePath("Makefile");
+    writeFile(project.makefile, MAKEFILE, &project.bytes);
+    project.headers.append(root.absoluteFilePath("inc/hal_conf.h"));
+    writeFile(project.headers.last(), HAL_CONF, &project.bytes);
+
+    const int headers = qMax(options.headers, 1);
+    for (int i = 0; i < headers; i++) {
+        auto p = QString("PERIPH%1").arg(i);
+        QStringList lines;
+        lines << QString("#ifndef HAL_%1_H").arg(p)
+              << QString("#define HAL_%1_H").arg(p)
+              << ""
+              << "#include \"hal_conf.h\"";
+        // A shallow tree of headers so the include graph has some depth
+        if (i > 0)
+            lines << QString("#include \"hal_periph%1.h\"").arg((i - 1) / 2);
+        lines << ""
+              << QString("#define %1_BASE (0x40000000UL + 0x%2UL)").arg(p).arg(i * 0x400, 0, 16);
+        for (int k = 0; k < options.macrosPerHeader; k++) {
+            auto macro = QString("%1_FLAG_%2").arg(p).arg(k);
+            lines << QString("#define %1 ((uint32_t)(1U << %2))").arg(macro).arg(k % 32);
+            project.macros.append(macro);
+        }
+        lines << ""
+              << "typedef struct {"
+              << "    volatile uint32_t CR;"
+              << "    volatile uint32_t SR;"
+              << "    volatile uint32_t DR;"
+              << QString("} %1_TypeDef;").arg(p)
+              << ""
+              << "typedef enum {"
+              << QString("    %1_OK = 0,").arg(p)
+              << QString("    %1_ERROR,").arg(p)
+              << QString("    %1_BUSY").arg(p)
+              << QString("} %1_StatusTypeDef;").arg(p)
+              << ""
+              << QString("#define %1 ((%1_TypeDef *) %1_BASE)").arg(p)
+              << ""
+              << QString("void HAL_%1_Init(%1_TypeDef *p);").arg(p)
+              << QString("%1_StatusTypeDef HAL_%1_WritePin(%1_TypeDef *p, uint32_t pin, int state);").arg(p)
+              << QString("uint32_t HAL_%1_ReadPin(%1_TypeDef *p, uint32_t pin);").arg(p)
+              << ""
+              << QString("#endif /* HAL_%1_H */").arg(p);
+        project.functions << QString("HAL_%1_Init").arg(p)
+                          << QString("HAL_%1_WritePin").arg(p)
+                          << QString("HAL_%1_ReadPin").arg(p);
+        project.headers.append(root.absoluteFilePath(QString("inc/hal_periph%1.h").arg(i)));
+        writeFile(project.headers.last(), joinLines(lines), &project.bytes);
+    }
+
+    const int sources = qMax(options.sources, 1);
+    const int functions = qMax(options.functionsPerSource, 1);
+    for (int j = 0; j < sources; j++) {
+        QStringList lines;
+        QList<int> included;
+        for (int n = 0; n < options.includesPerSource && included.size() < headers; n++) {
+            int h = pick(headers);
+            while (included.contains(h))
+                h = (h + 1) % headers;
+            included.append(h);
+            lines << QString("#include \"hal_periph%1.h\"").arg(h);
+        }
+        if (included.isEmpty()) {
+            included.append(0);
+            lines << "#include \"hal_periph0.h\"";
+        }
+        lines << "";
+        for (int f = 0; f < functions; f++)
+            lines << QString("void module%1_task%2(void);").arg(j).arg(f);
+        int other = pick(sources);
+        if (other != j)
+            lines << QString("extern void module%1_task0(void);").arg(other);
+        lines << "" << QString("static uint32_t module%1_state;").arg(j) << "";
+
+        auto path = root.absoluteFilePath(QString("src/module%1.c").arg(j));
+        for (int f = 0; f < functions; f++) {
+            auto p = QString("PERIPH%1").arg(included.at(pick(included.size())));
+            auto flag = QString("%1_FLAG_%2").arg(p).arg(pick(options.macrosPerHeader));
+            lines << QString("void module%1_task%2(void)").arg(j).arg(f)
+                  << "{"
+                  << QString("    uint32_t value = HAL_%1_ReadPin(%1, %2);").arg(p, flag)
+                  << "    if (value) {";
+            if (f == 0)
+                project.completionPoints.append(CompletionPoint{ path, lines.size(), 8, "HAL_PER", QString("HAL_%1_WritePin").arg(p) });
+            lines << QString("        HAL_%1_WritePin(%1, %2, 1);").arg(p, flag)
+                  << "    }"
+                  << QString("    module%1_state += value;").arg(j);
+            if (f == 0 && other != j)
+                lines << QString("    module%1_task0();").arg(other);
+            lines << "}" << "";
+            project.functions.append(QString("module%1_task%2").arg(j).arg(f));
+        }
+        if (j == 0) {
+            lines << "int main(void)"
+                  << "{"
+                  << "    for (;;)"
+                  << "        module0_task0();"
+                  << "}";
+        }
+        project.sources.append(path);
+        writeFile(path, joinLines(lines), &project.bytes);
+    }
+    return project;
+}
@@ -0,0 +1,58 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PROJECTGENERATOR_H
+#define PROJECTGENERATOR_H
+
+#include <QStringList>
+
+class ProjectGenerator
+{
+public:
+    struct Options {
+        int sources = 200;
+        int headers = 50;
+        int macrosPerHeader = 40;
+        int functionsPerSource = 10;
+        int includesPerSource = 4;
+        quint32 seed = 1;
+    };
+
+    // A place where an identifier is being typed, line and column are 0 based
+    struct CompletionPoint {
+        QString path;
+        int line;
+        int column;
+        QString prefix;
+        QString word;
+    };
+
+    struct Project {
+        QString makefile;
+        QStringList sources;
+        QStringList headers;
+        QStringList functions;
+        QStringList macros;
+        QList<CompletionPoint> completionPoints;
+        qint64 bytes = 0;
+    };
+
+    static Project generate(const QString& directory, const Options& options);
+};
+
+#endif // PROJECTGENERATOR_H
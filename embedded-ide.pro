@@ -1,2 +1,2 @@
 TEMPLATE = subdirs
-SUBDIRS = ide socketwaiter qtshdialog
+SUBDIRS = ide socketwaiter qtshdialog benchmark
@@ -273,6 +273,11 @@ QString AppConfig::templatesPath() const
     return ensureExist(QDir(workspacePath()).absoluteFilePath("templates"));
 }
 
+QString AppConfig::cachePath() const
+{
+    return ensureExist(QDir(workspacePath()).absoluteFilePath(".cache"));
+}
+
 QString AppConfig::localConfigFilePath() const
 {
     return QDir(ensureExist(workspacePath())).absoluteFilePath("config.json");
@@ -382,6 +387,16 @@ bool AppConfig::editorDetectIdent() const
     return CFG_LOCAL.value("editor").toObject().value("detectIdent").toBool();
 }
 
+int AppConfig::editorMemoryBudget() const
+{
+    return CFG_LOCAL.value("editor").toObject().value("memoryBudget").toInt(512);
+}
+
+bool AppConfig::editorFormatOnSave() const
+{
+    return CFG_LOCAL.value("editor").toObject().value("formatOnSave").toBool();
+}
+
 QFont AppConfig::loggerFont() const
 {
     auto ed = CFG_LOCAL.value("logger").toObject();
@@ -439,6 +454,11 @@ bool AppConfig::useDarkStyle() const
     return CFG_LOCAL.value("useDarkStyle").toBool();
 }
 
+bool AppConfig::useTextIndex() const
+{
+    return CFG_LOCAL.value("useTextIndex").toBool();
+}
+
 QString AppConfig::language() const
 {
     return CFG_LOCAL.value("lang").toString();
@@ -598,6 +618,20 @@ void AppConfig::setEditorDetectIdent(bool enable)
     CFG_LOCAL["editor"] = ed;
 }
 
+void AppConfig::setEditorMemoryBudget(int mib)
+{
+    auto ed = CFG_LOCAL["editor"].toObject();
+    ed.insert("memoryBudget", mib);
+    CFG_LOCAL["editor"] = ed;
+}
+
+void AppConfig::setEditorFormatOnSave(bool enable)
+{
+    auto ed = CFG_LOCAL["editor"].toObject();
+    ed.insert("formatOnSave", enable);
+    CFG_LOCAL["editor"] = ed;
+}
+
 void AppConfig::setLoggerFont(const QFont &f)
 {
     auto log = CFG_LOCAL["logger"].toObject();
@@ -680,6 +714,11 @@ void AppConfig::setUseDarkStyle(bool use)
     CFG_LOCAL.insert("useDarkStyle", use);
 }
 
+void AppConfig::setUseTextIndex(bool use)
+{
+    CFG_LOCAL.insert("useTextIndex", use);
+}
+
 void AppConfig::setLanguage(const QString &lang)
 {
     CFG_LOCAL.insert("lang", lang);
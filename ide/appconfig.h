@@ -53,6 +53,7 @@ public:
     QString workspacePath() const;
     QString projectsPath() const;
     QString templatesPath() const;
+    QString cachePath() const;
     QString localConfigFilePath() const;
 
     QList<QPair<QString, QString> > externalTools() const;
@@ -72,6 +73,8 @@ public:
     QString editorFormatterStyle() const;
     QString editorFormatterExtra() const;
     bool editorDetectIdent() const;
+    int editorMemoryBudget() const;
+    bool editorFormatOnSave() const;
 
     QFont loggerFont() const;
 
@@ -86,6 +89,7 @@ public:
 
     bool useDevelopMode() const;
     bool useDarkStyle() const;
+    bool useTextIndex() const;
 
     QString language() const;
 
@@ -119,6 +123,8 @@ public slots:
     void setEditorFormatterStyle(const QString& name);
     void setEditorFormatterExtra(const QString& text);
     void setEditorDetectIdent(bool enable);
+    void setEditorMemoryBudget(int mib);
+    void setEditorFormatOnSave(bool enable);
 
     void setLoggerFont(const QFont& f);
 
@@ -133,6 +139,7 @@ public slots:
 
     void setUseDevelopMode(bool use);
     void setUseDarkStyle(bool use);
+    void setUseTextIndex(bool use);
     void setLanguage(const QString& lang);
 
     void setNumberOfJobs(int n);
@@ -33,6 +33,14 @@ QProcess *ChildProcess::safeStop(QProcess *p, int timeoutMilis)
     return p;
 }
 
+void ChildProcess::cancel(QProcess *p)
+{
+    // Nobody is waiting for the result, drop it without notifications
+    p->blockSignals(true);
+    p->kill();
+    p->deleteLater();
+}
+
 ChildProcess::~ChildProcess() {
     safeStop(this);
 }
@@ -28,6 +28,7 @@ public:
     static ChildProcess& create(QObject *parent = nullptr) { return *new ChildProcess(parent); }
 
     static QProcess *safeStop(QProcess *p, int timeoutMilis = 100);
+    static void cancel(QProcess *p);
 
     explicit ChildProcess(QObject *parent = nullptr): QProcess(parent) {}
     virtual ~ChildProcess();
@@ -50,6 +51,8 @@ public:
 
     ChildProcess& setenv(const QHash<QString, QString> &extraEnv) {
         QProcessEnvironment env = processEnvironment();
+        if (env.isEmpty())
+            env = QProcessEnvironment::systemEnvironment();
         for(auto it = extraEnv.begin(); it != extraEnv.end(); ++it)
             env.insert(it.key(), it.value());
         setProcessEnvironment(env);
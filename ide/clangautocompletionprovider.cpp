@@ -19,12 +19,20 @@
 #include "appconfig.h"
 #include "childprocess.h"
 #include "clangautocompletionprovider.h"
+#include "compilecommanddatabase.h"
+#include "includegraph.h"
 #include "projectmanager.h"
+#include "semantickeywords.h"
 #include "textmessagebrocker.h"
+#include "toolchainregistry.h"
+#include "usageindex.h"
 
+#include <QFile>
+#include <QFutureWatcher>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QPointer>
 #include <QProcess>
 #include <QRegularExpressionMatch>
 #include <QTimer>
@@ -33,94 +41,65 @@
 
 #include <QtDebug>
 
-static QString getToken(QTextStream *s)
-{
-    bool escaped = false;
-    QChar cuoting = QChar();
-    QString token;
-    while(!s->atEnd()) {
-        QChar c;
-        *s >> c;
-        if (QString(" \t").contains(c)) {
-            if (!cuoting.isNull()) {
-                token += c;
-                continue;
-            }
-            if (token.isEmpty()) {
-                if (cuoting == QChar())
-                    continue;
-            } else
-                break;
-        }
-        if (QString("\"'").contains(c)) {
-            if (!escaped) {
-                if (cuoting == c)
-                    cuoting = QChar();
-                else if (cuoting.isNull())
-                    cuoting = c;
-            } else
-                escaped = false;
-            token += c;
-            continue;
-        }
-        escaped = !cuoting.isNull() && (c == '\\');
-        token += c;
+struct CompletionKey {
+    QString path;
+    int line{ -1 };
+    int column{ -1 };
+    int revision{ -1 };
+
+    bool operator ==(const CompletionKey& other) const {
+        return path == other.path &&
+               line == other.line &&
+               column == other.column &&
+               revision == other.revision;
     }
-    return token;
-}
+};
 
-static QStringList cmdLineTokenizer(const QString& line)
-{
-    QStringList tokens;
-    QString token;
-    QTextStream stream(line.toLocal8Bit(), QIODevice::ReadOnly);
-    while(!(token = getToken(&stream)).isNull())
-        tokens.append(token);
-    return tokens;
-}
+struct CompletionCache {
+    CompletionKey key;
+    QStringList items;
+    QString narrowedPrefix;
+    QStringList narrowed;
+
+    QStringList narrow(const QString& prefix) {
+        // Each keystroke extends the prefix, so filter from the last narrowed list when possible
+        const auto& from = (!narrowedPrefix.isNull() && prefix.startsWith(narrowedPrefix))? narrowed : items;
+        QStringList list;
+        for(const auto& e: from)
+            if (e.startsWith(prefix))
+                list.append(e);
+        narrowedPrefix = prefix;
+        narrowed = list;
+        return list;
+    }
+};
 
-static const QRegularExpression EOL(R"([\r\n])");
+// ctags kinds highlighted as user types by the C/C++ lexer
+static const QStringList KEYWORD_TYPES = { "enum", "enumerator", "macro", "struct", "typedef", "union" };
 
-static void parseCompilerInfo(const QString& text, QStringList *incs, QStringList *defs)
+static const QStringList PATH_OPTIONS = { "-I", "-isystem", "-iquote", "-idirafter", "-include", "-imacros" };
+static const QStringList VALUE_OPTIONS = { "-D", "-U" };
+static QStringList completionFlagsFromCommand(const CompileCommandDatabase::Command& cmd)
 {
-#if 0
-    QRegularExpression definesRe(R"(^\#define (\S+) (.*?)$)", QRegularExpression::MultilineOption);
-    auto it = definesRe.globalMatch(text);
-    while (it.hasNext()) {
-        QRegularExpressionMatch m = it.next();
-#if 1
-        QString define = m.captured(0);
-        defs->append(define);
-#else
-        QString symbol = m.captured(1).remove(EOL);
-        QString value = m.captured(2).remove(EOL);
-        if (value.contains(QRegularExpression("[ \\t]")))
-            value = value.prepend('"').append('"');
-        defs->append(QString("%1=%2").arg(symbol).arg(value));
-#endif
-    }
-#else
-    Q_UNUSED(defs)
-#endif
-    bool onIncludes = false;
-    for(const QString& line: text.split('\n')) {
-        if (!onIncludes) {
-            if (line.startsWith("#include <")) {
-                onIncludes = true;
-            }
-        } else {
-            if (line.startsWith("End of search list"))
-                onIncludes = false;
-            else {
-                QString ipath = line.trimmed();
-                if (!incs->contains(ipath))
-                    incs->append("-I" + ipath);
-            }
+    QStringList flags;
+    QDir cwd(cmd.directory);
+    const auto& args = cmd.arguments;
+    for(int i = 1; i < args.size(); i++) {
+        const auto& arg = args.at(i);
+        if (PATH_OPTIONS.contains(arg) && i + 1 < args.size()) {
+            flags << arg << cwd.absoluteFilePath(args.at(++i));
+        } else if (VALUE_OPTIONS.contains(arg) && i + 1 < args.size()) {
+            flags << arg << args.at(++i);
+        } else if (arg.startsWith("-I") || arg.startsWith("-isystem")) {
+            auto opt = arg.startsWith("-I")? QString("-I") : QString("-isystem");
+            flags << opt + cwd.absoluteFilePath(arg.mid(opt.size()));
+        } else if (arg.startsWith("-D") || arg.startsWith("-U") || arg.startsWith("-std=")) {
+            flags << arg;
         }
     }
+    return flags;
 }
 
-
 class ClangAutocompletionProvider::Priv_t
 {
 public:
@@ -128,15 +107,90 @@ public:
     ProjectManager *project{ nullptr };
     QHash<QString, ICodeModelProvider::FileReferenceList> nameMap;
     QHash<QString, ICodeModelProvider::SymbolSetMap> symbolsForFiles;
-    QStringList includes;
-    QStringList defines;
-    QByteArray buffer;
+    CompileCommandDatabase *compileDb{ nullptr };
+    ToolchainRegistry *toolchains{ nullptr };
+    UsageIndex usages;
+    QPointer<QFutureWatcher<UsageIndex::FileUsages>> usageWatcher;
+    int usageGeneration{ 0 };
+    IncludeGraph includeGraph;
+    QPointer<QFutureWatcher<IncludeGraph>> includeWatcher;
+    // Single file scans that landed while a full build was running, applied again over its result
+    QHash<QString, IncludeGraph::FileIncludes> pendingIncludes;
+    int includeGeneration{ 0 };
+    QTimer *includeGraphTimer{ nullptr };
+    QHash<QString, QStringList> completionFlags;
+
+    QHash<QString, CompletionCache> completionCache;
+    QPointer<QProcess> completionProcess;
+    CompletionKey completionKey;
+    QString completionPrefix;
+    ICodeModelProvider::CompletionCallback_t completionCallback;
+
+    void cancelCompletion() {
+        if (completionProcess)
+            ChildProcess::cancel(completionProcess);
+        completionProcess.clear();
+        completionCallback = nullptr;
+    }
+
+    QStringList completionFlagsFor(const QString& path) {
+        auto it = completionFlags.find(path);
+        if (it == completionFlags.end()) {
+            auto cmd = compileDb->commandFor(path);
+            auto flags = QStringList{ "-x", cmd.isCXX()? "c++" : "c" } + completionFlagsFromCommand(cmd);
+            for(const auto& path: toolchains->find(cmd.arguments, cmd.isCXX(), cmd.directory).includePaths)
+                flags << "-I" + path;
+            it = completionFlags.insert(path, flags);
+        }
+        return it.value();
+    }
 };
 
 ClangAutocompletionProvider::ClangAutocompletionProvider(ProjectManager *proj, QObject *parent):
     QObject(parent), priv(std::make_unique<Priv_t>())
 {
     priv->project = proj;
+    priv->compileDb = new CompileCommandDatabase(this);
+    priv->toolchains = new ToolchainRegistry(this);
+    priv->includeGraphTimer = new QTimer(this);
+    priv->includeGraphTimer->setSingleShot(true);
+    priv->includeGraphTimer->setInterval(500);
+    connect(priv->includeGraphTimer, &QTimer::timeout, this, &ClangAutocompletionProvider::rebuildIncludeGraph);
+    connect(proj, &ProjectManager::makeDatabaseUpdated, [this](const QByteArray& signature) {
+        priv->compileDb->update(priv->project->projectFile(), signature);
+    });
+    connect(proj, &ProjectManager::projectClosed, [this]() {
+        if (priv->usageWatcher)
+            priv->usageWatcher->cancel();
+        priv->usages.clear();
+        priv->usageGeneration++;
+        priv->includeGraphTimer->stop();
+        priv->includeWatcher.clear();
+        priv->includeGraph.clear();
+        priv->pendingIncludes.clear();
+        priv->includeGeneration++;
+        priv->compileDb->clear();
+        SemanticKeywords::instance().publish(nullptr);
+        priv->completionFlags.clear();
+    });
+    connect(priv->compileDb, &CompileCommandDatabase::updated, [this]() {
+        priv->completionFlags.clear();
+        QSet<QString> probed;
+        for(const auto& cmd: priv->compileDb->commands()) {
+            auto key = ToolchainRegistry::commandKey(cmd.arguments, cmd.isCXX());
+            if (!probed.contains(key)) {
+                probed.insert(key);
+                priv->toolchains->probe(cmd.arguments, cmd.isCXX(), cmd.directory);
+            }
+        }
+        priv->includeGraphTimer->start();
+    });
+    connect(priv->toolchains, &ToolchainRegistry::toolchainReady, [this]() {
+        priv->completionFlags.clear();
+        priv->includeGraphTimer->start();
+    });
+    connect(&AppConfig::instance(), &AppConfig::configChanged, priv->toolchains, &ToolchainRegistry::discover);
+    priv->toolchains->discover();
 }
 
 ClangAutocompletionProvider::~ClangAutocompletionProvider() {}
@@ -144,6 +198,8 @@ ClangAutocompletionProvider::~ClangAutocompletionProvider() {}
 void ClangAutocompletionProvider::startIndexingProject(const QString &path, FinishIndexProjectCallback_t cb)
 {
     priv->nameMap.clear();
+    priv->cancelCompletion();
+    priv->completionCache.clear();
     auto& p = ChildProcess::create(this)
     .changeCWD(path)
     .onError([this](QProcess *ctags, QProcess::ProcessError) {
@@ -155,6 +211,7 @@ void ClangAutocompletionProvider::startIndexingProject(const QString &path, Fini
         QtConcurrent::run([ctags, this, cb]() {
             ctags->setReadChannel(QProcess::StandardOutput);
             QDir cwd{ctags->workingDirectory()};
+            QSet<QString> keywords;
             while(ctags->bytesAvailable() > 0) {
                 auto line = ctags->readLine();
                 auto entry = QJsonDocument::fromJson(line).object();
@@ -188,11 +245,20 @@ void ClangAutocompletionProvider::startIndexingProject(const QString &path, Fini
                         ICodeModelProvider::Symbol sym{ name, text, lang, type, ref };
                         priv->nameMap[name].append(ref);
                         priv->symbolsForFiles[cwd.absoluteFilePath(path)][sym.type].insert(sym);
+                        if (KEYWORD_TYPES.contains(type) && !name.startsWith("__anon"))
+                            keywords.insert(name);
                     }
                 }
                 if (!priv->project->isProjectOpen())
                     break;
             }
+            if (priv->project->isProjectOpen()) {
+                // One list per index, shared by every open editor
+                auto list = SemanticKeywords::build(keywords);
+                QMetaObject::invokeMethod(&SemanticKeywords::instance(), [list]() {
+                    SemanticKeywords::instance().publish(list);
+                }, Qt::QueuedConnection);
+            }
             priv->project->showMessageTimed(tr("Index finished"));
             ctags->deleteLater();
             cb();
@@ -210,78 +276,149 @@ void ClangAutocompletionProvider::startIndexingProject(const QString &path, Fini
              });
     priv->project->showMessage(tr("Indexing by ctags..."));
     priv->project->deleteOnCloseProject(&p);
+
+    if (priv->usageWatcher)
+        priv->usageWatcher->cancel();
+    priv->usages.clear();
+    priv->usageGeneration++;
+    auto watcher = new QFutureWatcher<UsageIndex::FileUsages>(this);
+    connect(watcher, &QFutureWatcher<UsageIndex::FileUsages>::resultsReadyAt, [this, watcher](int begin, int end) {
+        if (priv->usageWatcher != watcher)
+            return;
+        for (int i = begin; i < end; i++)
+            priv->usages.merge(watcher->resultAt(i));
+    });
+    connect(watcher, &QFutureWatcher<UsageIndex::FileUsages>::finished, [this, watcher]() {
+        if (priv->usageWatcher == watcher && !watcher->isCanceled()) {
+            qDebug() << "usage index with" << priv->usages.symbolCount() << "symbols in" << priv->usages.fileCount() << "files";
+            emit usageIndexFinished();
+        }
+        watcher->deleteLater();
+    });
+    priv->usageWatcher = watcher;
+    watcher->setFuture(QtConcurrent::mapped(UsageIndex::sourceFiles(path), UsageIndex::scanFile));
+
+    priv->includeGraph.clear();
+    priv->includeGraphTimer->start();
 }
 
 void ClangAutocompletionProvider::startIndexingFile(const QString &path, FinishIndexFileCallback_t cb)
 {
-    Q_UNUSED(path)
-    auto targets = priv->project->targetsOfDependency(path);
-    auto& p = ChildProcess::create(this)
-            .makeDeleteLater()
-            .changeCWD(priv->project->projectPath())
-            .onFinished([this, cb](QProcess *make, int exitCode)
-    {
-        qDebug() << "make discover exit with" << exitCode;
-        QString out = make->readAllStandardOutput();
-        QRegularExpression re(R"((\S+[g]*(cc|\+\+))\S*\s+(.*?$))", QRegularExpression::MultilineOption);
-        QRegularExpressionMatch m = re.match(out);
-        if (m.hasMatch()) {
-            QString compiler = m.captured(1);
-            QString compiler_type = m.captured(2);
-            QString parameters = m.captured(3);
-            qDebug() << "CC:" << compiler << ", type " << compiler_type;
-            QStringList parameterList = cmdLineTokenizer(parameters);
-            QList<int> toRemove;
-            int idx = 0;
-            for(const QString& arg: parameterList) {
-                if (arg.startsWith("-I"))
-                    priv->includes.append(arg);
-                else if (arg.startsWith("-D"))
-                    priv->defines.append(arg);
-                else if (QRegularExpression(R"(^-(?:MMD|MM|MG|MP|MD|M)$)").match(arg).hasMatch())
-                    toRemove << idx;
-                else if (QRegularExpression(R"(^-(?:MQ|MT|MF)$)").match(arg).hasMatch())
-                    toRemove << idx << (idx + 1);
-                else if (arg == "-c")
-                    toRemove.append(idx);
-                else if (arg == "-o")
-                    toRemove << idx << (idx + 1);
-                idx++;
+    // Flags come from the compile database, nothing to run per file
+    priv->completionFlagsFor(path);
+    if (UsageIndex::isSourceFile(path) && !priv->usages.isUpToDate(path)) {
+        auto watcher = new QFutureWatcher<UsageIndex::FileUsages>(this);
+        auto generation = priv->usageGeneration;
+        connect(watcher, &QFutureWatcher<UsageIndex::FileUsages>::finished, [this, watcher, generation]() {
+            // The index was cleared since this scan started, the file belongs to the old one
+            if (priv->usageGeneration == generation)
+                priv->usages.merge(watcher->result());
+            watcher->deleteLater();
+        });
+        watcher->setFuture(QtConcurrent::run(UsageIndex::scanFile, path));
+    }
+    auto absolutePath = QDir::cleanPath(QFileInfo(path).absoluteFilePath());
+    if (priv->includeGraph.contains(absolutePath) || IncludeGraph::isTranslationUnit(absolutePath)) {
+        auto searchPaths = IncludeGraph::searchPathsFromFlags(priv->completionFlagsFor(path));
+        auto watcher = new QFutureWatcher<IncludeGraph::FileIncludes>(this);
+        auto generation = priv->includeGeneration;
+        connect(watcher, &QFutureWatcher<IncludeGraph::FileIncludes>::finished, [this, watcher, generation]() {
+            if (priv->includeGeneration == generation) {
+                auto file = watcher->result();
+                if (priv->includeWatcher)
+                    priv->pendingIncludes.insert(file.path, file);
+                priv->includeGraph.merge(file);
+                // Only the sources that see this file can have stale completions
+                for (const auto& unit: priv->includeGraph.affectedTranslationUnits(file.path))
+                    if (unit != file.path)
+                        priv->completionCache.remove(unit);
             }
-            std::sort(toRemove.begin(), toRemove.end(),
-                  [](int a, int b) -> bool { return a > b; });
-            for(const auto& i: toRemove)
-                parameterList.removeAt(i);
-            parameterList.append("-dM");
-            parameterList.append("-E");
-            parameterList.append("-v");
-            qDebug() << parameterList;
-            auto& p = ChildProcess::create(this)
-                    .changeCWD(make->workingDirectory())
-                    .mergeStdOutAndErr()
-                    .makeDeleteLater()
-                    .onFinished([this](QProcess *cc, int) {
-                QString out = cc->readAll();
-                parseCompilerInfo(out, &priv->includes, &priv->defines);
-                qDebug() << "Includes:" << priv->includes;
-                qDebug() << "Defines:" << priv->defines;
-            }).onError([](QProcess *cc, QProcess::ProcessError err) {
-                Q_UNUSED(err)
-                qDebug() << "CC ERROR: " << cc->program() << cc->arguments() << "\n"
-                         << "\t" << cc->errorString();
-            });
-            p.start(compiler, parameterList);
-            priv->project->deleteOnCloseProject(&p);
-            cb();
+            watcher->deleteLater();
+        });
+        watcher->setFuture(QtConcurrent::run(IncludeGraph::scanFile, absolutePath, searchPaths));
+    }
+    cb();
+}
+
+void ClangAutocompletionProvider::rebuildIncludeGraph()
+{
+    QHash<QString, QStringList> sources;
+    const auto commands = priv->compileDb->commands();
+    if (!commands.isEmpty()) {
+        for (const auto& cmd: commands)
+            sources.insert(cmd.file, IncludeGraph::searchPathsFromFlags(priv->completionFlagsFor(cmd.file)));
+    } else {
+        for (const auto& path: UsageIndex::sourceFiles(priv->project->projectPath()))
+            if (IncludeGraph::isTranslationUnit(path))
+                sources.insert(path, IncludeGraph::searchPathsFromFlags(priv->completionFlagsFor(path)));
+    }
+    auto watcher = new QFutureWatcher<IncludeGraph>(this);
+    connect(watcher, &QFutureWatcher<IncludeGraph>::finished, [this, watcher]() {
+        if (priv->includeWatcher == watcher) {
+            priv->includeGraph = watcher->result();
+            priv->includeWatcher.clear();
+            for (const auto& file: priv->pendingIncludes)
+                priv->includeGraph.merge(file);
+            priv->pendingIncludes.clear();
         }
+        watcher->deleteLater();
     });
-    p.start("make", QStringList{ "-B", "-n" } + targets);
-    priv->project->deleteOnCloseProject(&p);
+    priv->includeWatcher = watcher;
+    watcher->setFuture(QtConcurrent::run(IncludeGraph::build, sources));
+}
+
+// Usages come with absolute paths from firstUsage on, their line text is read here
+// stopping at the last line asked for in each file, and paths made project relative
+static ICodeModelProvider::FileReferenceList readUsageLines(ICodeModelProvider::FileReferenceList refs,
+                                                            int firstUsage, const QString& projectPath)
+{
+    QDir projectDir(projectPath);
+    QHash<QString, QVector<int>> byFile;
+    for (int i = firstUsage; i < refs.size(); i++)
+        byFile[refs.at(i).path].append(i);
+    for (auto it = byFile.constBegin(); it != byFile.constEnd(); ++it) {
+        int last = 0;
+        for (auto i: it.value())
+            last = qMax(last, refs.at(i).line);
+        QList<QByteArray> lines;
+        QFile f(it.key());
+        if (f.open(QFile::ReadOnly))
+            while (lines.size() < last && !f.atEnd())
+                lines.append(f.readLine());
+        for (auto i: it.value()) {
+            auto& r = refs[i];
+            r.meta = QString::fromUtf8(lines.value(r.line - 1)).trimmed();
+            r.path = projectDir.relativeFilePath(r.path);
+        }
+    }
+    return refs;
 }
 
 void ClangAutocompletionProvider::referenceOf(const QString &entity, ICodeModelProvider::FindReferenceCallback_t cb)
 {
-    cb(priv->nameMap.value(entity));
+    // Definitions from ctags first, then every other use from the usage index
+    auto refs = priv->nameMap.value(entity);
+    auto projectPath = priv->project->projectPath();
+    QDir projectDir(projectPath);
+    QSet<QString> definitions;
+    for (const auto& r: refs)
+        definitions.insert(QString("%1:%2").arg(QDir::cleanPath(projectDir.absoluteFilePath(r.path))).arg(r.line));
+    int firstUsage = refs.size();
+    for (const auto& u: priv->usages.find(entity.toUtf8())) {
+        if (!definitions.contains(QString("%1:%2").arg(u.path).arg(u.line)))
+            refs.append(ICodeModelProvider::FileReference{ u.path, u.line, u.column, QString() });
+    }
+    if (firstUsage == refs.size()) {
+        cb(refs);
+        return;
+    }
+    // Reading the source lines of a widely used symbol takes a while, keep it off the GUI thread
+    auto watcher = new QFutureWatcher<ICodeModelProvider::FileReferenceList>(this);
+    connect(watcher, &QFutureWatcher<ICodeModelProvider::FileReferenceList>::finished, [watcher, cb]() {
+        cb(watcher->result());
+        watcher->deleteLater();
+    });
+    watcher->setFuture(QtConcurrent::run(readUsageLines, refs, firstUsage, projectPath));
 }
 
 static QString parseCompletion(const QString& text)
@@ -292,40 +429,75 @@ static QString parseCompletion(const QString& text)
                     QString(text.split(':').at(0)).trimmed() : text;
 }
 
-void ClangAutocompletionProvider::completionAt(const ICodeModelProvider::FileReference &ref, const QString &unsaved, ICodeModelProvider::CompletionCallback_t cb)
+void ClangAutocompletionProvider::completionAt(const ICodeModelProvider::FileReference &ref,
+                                               const QString &prefix, int revision,
+                                               const QByteArray &unsaved,
+                                               ICodeModelProvider::CompletionCallback_t cb)
 {
+    CompletionKey key{ ref.path, ref.line, ref.column, revision };
+    auto cache = priv->completionCache.find(ref.path);
+    if (cache != priv->completionCache.end() && cache->key == key) {
+        cb(cache->narrow(prefix));
+        return;
+    }
+
+    // Same word and same context is still computing, only the newest callback survives
+    priv->completionPrefix = prefix;
+    if (priv->completionProcess && priv->completionKey == key) {
+        priv->completionCallback = cb;
+        return;
+    }
+
+    priv->cancelCompletion();
+    priv->completionKey = key;
+    priv->completionCallback = cb;
+    // unsaved may point straight into the editor buffer, detach it before going async
+    auto document = QByteArray(unsaved.constData(), unsaved.size());
     auto& p = ChildProcess::create(this)
             .makeDeleteLater()
             .changeCWD(priv->project->projectPath())
-            .onStarted([unsaved](QProcess *clang) {
-        clang->write(unsaved.toLocal8Bit());
-        clang->waitForBytesWritten();
+            .onStarted([document](QProcess *clang) {
+        clang->write(document);
         clang->closeWriteChannel();
-    }).onError([](QProcess *clang, QProcess::ProcessError err) {
+    }).onError([this](QProcess *clang, QProcess::ProcessError err) {
         qDebug() << "clang error:" << clang->errorString() << err;
-    }).onFinished([cb](QProcess *clang, int exitStatus) {
+        if (err == QProcess::FailedToStart && priv->completionProcess == clang) {
+            auto callback = priv->completionCallback;
+            priv->completionProcess.clear();
+            priv->completionCallback = nullptr;
+            if (callback)
+                callback({});
+        }
+    }).onFinished([this, key](QProcess *clang, int exitStatus) {
         Q_UNUSED(exitStatus)
-        clang->deleteLater();
-        // qDebug() << "clang finish:" << exitStatus;
+        if (priv->completionProcess != clang)
+            return;
+        priv->completionProcess.clear();
         QStringList list;
         QString out = clang->readAllStandardOutput();
-        // qDebug() << "clang out:\n" << out;
         QRegularExpression re(R"(^COMPLETION: (.*?)$)", QRegularExpression::MultilineOption);
         auto it = re.globalMatch(out);
         while(it.hasNext()) {
             auto m = it.next();
             list.append(parseCompletion(m.captured(1)));
         }
-        cb(list);
+        list.removeDuplicates();
+        auto& entry = priv->completionCache[key.path];
+        entry = CompletionCache{ key, list, QString(), QStringList() };
+        auto callback = priv->completionCallback;
+        priv->completionCallback = nullptr;
+        if (callback)
+            callback(entry.narrow(priv->completionPrefix));
     });
-    p.start("clang", QStringList{
-                 "-x", "c", "-fcolor-diagnostics", "-fsyntax-only",
+    priv->completionProcess = &p;
+    p.start("clang", priv->completionFlagsFor(ref.path) + QStringList{
+                 "-fcolor-diagnostics", "-fsyntax-only",
                  "-Xclang", "-code-completion-macros",
                  "-Xclang", "-code-completion-patterns",
                  "-Xclang", "-code-completion-brief-comments",
                  "-Xclang", QString("-code-completion-at=-:%1:%2").arg(ref.line + 1).arg(ref.column + 1),
                  "-"
-             } + priv->defines + priv->includes);
+             });
     priv->project->deleteOnCloseProject(&p);
 }
 
@@ -333,3 +505,55 @@ void ClangAutocompletionProvider::requestSymbolForFile(const QString &path, ICod
 {
     cb(priv->symbolsForFiles.value(path));
 }
+
+void ClangAutocompletionProvider::wordCompletions(const QString &prefix, int limit, ICodeModelProvider::CompletionCallback_t cb)
+{
+    cb(priv->usages.complete(prefix.toUtf8(), limit));
+}
+
+void ClangAutocompletionProvider::affectedTranslationUnits(const QString &path, ICodeModelProvider::AffectedFilesCallback_t cb)
+{
+    cb(priv->includeGraph.affectedTranslationUnits(QDir::cleanPath(QFileInfo(path).absoluteFilePath())));
+}
+
+void ClangAutocompletionProvider::includeCosts(ICodeModelProvider::IncludeCostCallback_t cb)
+{
+    auto graph = priv->includeGraph;
+    auto watcher = new QFutureWatcher<IncludeCostMap>(this);
+    connect(watcher, &QFutureWatcher<IncludeCostMap>::finished, [watcher, cb]() {
+        cb(watcher->result());
+        watcher->deleteLater();
+    });
+    watcher->setFuture(QtConcurrent::run([graph]() { return graph.headerCosts(); }));
+}
+
+void ClangAutocompletionProvider::macrosFor(const QString &path, ICodeModelProvider::MacrosCallback_t cb)
+{
+    MacroMap macros;
+    auto cmd = priv->compileDb->commandFor(path);
+    if (cmd.isEmpty()) {
+        cb(false, macros);
+        return;
+    }
+    // Builtins come as NAME or NAME=VALUE straight from the compiler, -DNAME means NAME=1
+    auto define = [&macros](const QString& def, const QByteArray& implicit) {
+        auto eq = def.indexOf('=');
+        if (eq == -1)
+            macros.insert(def.toUtf8(), implicit);
+        else
+            macros.insert(def.left(eq).toUtf8(), def.mid(eq + 1).toUtf8());
+    };
+    for (const auto& def: priv->toolchains->find(cmd.arguments, cmd.isCXX(), cmd.directory).macros)
+        define(def, QByteArray());
+    const auto flags = completionFlagsFromCommand(cmd);
+    for (int i = 0; i < flags.size(); i++) {
+        auto flag = flags.at(i);
+        if ((flag == "-D" || flag == "-U") && i + 1 < flags.size())
+            flag += flags.at(++i);
+        if (flag.startsWith("-D"))
+            define(flag.mid(2), "1");
+        else if (flag.startsWith("-U"))
+            macros.remove(flag.mid(2).toUtf8());
+    }
+    cb(true, macros);
+}
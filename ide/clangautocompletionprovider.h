@@ -37,10 +37,20 @@ public:
     void startIndexingFile(const QString& path, FinishIndexFileCallback_t cb) override;
 
     void referenceOf(const QString& entity, FindReferenceCallback_t cb) override;
-    void completionAt(const FileReference& ref, const QString& unsaved, CompletionCallback_t cb) override;
+    void completionAt(const FileReference& ref, const QString& prefix, int revision,
+                      const QByteArray& unsaved, CompletionCallback_t cb) override;
     void requestSymbolForFile(const QString& path, SymbolRequestCallback_t cb) override;
+    void wordCompletions(const QString& prefix, int limit, CompletionCallback_t cb) override;
+    void affectedTranslationUnits(const QString& path, AffectedFilesCallback_t cb) override;
+    void includeCosts(IncludeCostCallback_t cb) override;
+    void macrosFor(const QString& path, MacrosCallback_t cb) override;
+
+signals:
+    void usageIndexFinished();
 
 private:
+    void rebuildIncludeGraph();
+
     class Priv_t;
     std::unique_ptr<Priv_t> priv;
 };
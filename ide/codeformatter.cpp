@@ -0,0 +1,102 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "codeformatter.h"
+#include "appconfig.h"
+#include "linediff.h"
+
+#include <astyle.h>
+#include <astyle_main.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+// AStyle reports through plain function pointers, each worker collects its own messages
+static thread_local QStringList *formatErrors = nullptr;
+
+static STDCALL char *formatterAllocation(unsigned long memoryNeeded)
+{
+    return new char[memoryNeeded];
+}
+
+static STDCALL void formatterError(int errorNumber, const char *errorMessage)
+{
+    if (formatErrors)
+        formatErrors->append(QString("%1: %2").arg(errorNumber).arg(errorMessage));
+}
+
+QByteArray CodeFormatter::options()
+{
+    auto& cfg = AppConfig::instance();
+    const auto style = cfg.editorFormatterStyle();
+    const auto indentType = QString{cfg.editorTabsToSpaces()? "spaces" : "tab"};
+    const auto indentCount = QString("%1").arg(cfg.editorTabWidth());
+    return QString("--style=%1 --indent=%2=%3 %4")
+            .arg(style, indentType, indentCount, cfg.editorFormatterExtra()).toLatin1();
+}
+
+QByteArray CodeFormatter::format(const QByteArray &text, const QByteArray &options, QString *error)
+{
+    QStringList errors;
+    formatErrors = &errors;
+    char *out = AStyleMain(text.constData(), options.constData(), formatterError, formatterAllocation);
+    formatErrors = nullptr;
+    if (error)
+        *error = errors.join('\n');
+    if (!out)
+        return text;
+    QByteArray formatted(out);
+    delete[] out;
+    // AStyle drops the line end of the last line
+    if (text.endsWith('\n') && !formatted.endsWith('\n'))
+        formatted.append(text.endsWith("\r\n")? "\r\n" : "\n");
+    return formatted;
+}
+
+CodeFormatter::Result CodeFormatter::edits(const QByteArray &text, const QByteArray &options, const LineRanges &lines)
+{
+    Result result;
+    auto formatted = format(text, options, &result.error);
+    if (lines.isEmpty()) {
+        result.edits = LineDiff::edits(text, formatted);
+        return result;
+    }
+    // Uncapped, past the cap the diff falls back to one edit over everything
+    result.edits = LineDiff::edits(text, formatted, std::numeric_limits<int>::max());
+    // Edits are sorted and cover whole lines, keep the ones overlapping a changed line
+    QVector<int> lineStarts{ 0 };
+    for (int i = 0; i < text.size(); i++)
+        if (text.at(i) == '\n')
+            lineStarts.append(i + 1);
+    auto lineOf = [&lineStarts](int offset) {
+        return int(std::upper_bound(lineStarts.begin(), lineStarts.end(), offset) - lineStarts.begin()) - 1;
+    };
+    TextEditList kept;
+    for (const auto& e: result.edits) {
+        int first = lineOf(e.offset);
+        int last = e.length > 0? lineOf(e.offset + e.length - 1) : first;
+        auto touches = std::any_of(lines.begin(), lines.end(), [first, last](const QPair<int, int>& r) {
+            return r.first <= last && first <= r.second;
+        });
+        if (touches)
+            kept.append(e);
+    }
+    result.edits = kept;
+    return result;
+}
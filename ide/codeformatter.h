@@ -0,0 +1,47 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef CODEFORMATTER_H
+#define CODEFORMATTER_H
+
+#include "textedit.h"
+
+#include <QPair>
+#include <QVector>
+
+// AStyle wrapped to run on worker threads, results come as line edits so the
+// editor keeps markers, folds and styling of the lines left untouched
+class CodeFormatter
+{
+public:
+    using LineRanges = QVector<QPair<int, int>>; // first and last line, 0 based
+
+    struct Result {
+        TextEditList edits;
+        QString error;
+    };
+
+    // From the editor settings, read it on the GUI thread and hand it to the workers
+    static QByteArray options();
+    // Text unchanged and error set when AStyle fails
+    static QByteArray format(const QByteArray& text, const QByteArray& options, QString *error);
+    // Edits turning text into its formatted form, with lines given only the edits touching them
+    static Result edits(const QByteArray& text, const QByteArray& options, const LineRanges& lines = LineRanges());
+};
+
+#endif // CODEFORMATTER_H
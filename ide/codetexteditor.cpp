@@ -18,10 +18,10 @@
  */
 #include "appconfig.h"
 #include "codetexteditor.h"
+#include "fileclassifier.h"
 
 #include <QFileInfo>
 #include <QMenu>
-#include <QMimeDatabase>
 #include <QtDebug>
 
 #include <Qsci/qscilexeravs.h>
@@ -81,7 +81,7 @@ CodeTextEditor::~CodeTextEditor() = default;
 
 bool CodeTextEditor::load(const QString &path)
 {
-    setLexer(lexerFromFile(path));
+    setLexer(isLargeFile(path)? nullptr : lexerFromFile(path));
     auto r = PlainTextEditor::load(path);
     QFileInfo info(path);
     auto name = info.fileName();
@@ -211,7 +211,7 @@ QsciLexer *CodeTextEditor::lexerFromFile(const QString& name)
         qDebug() << "for" << name << "suffix found as" << suffix;
         return EXTENTION_MAP.value(suffix)();
     }
-    auto type = QMimeDatabase().mimeTypeForFile(name);
+    auto type = FileClassifier::classify(name).mime;
     auto mimename = type.name();
     if (MIMETYPE_MAP.contains(mimename)) {
         qDebug() << "for" << name << "mime found as" << mimename;
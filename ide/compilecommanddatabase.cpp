@@ -0,0 +1,357 @@
+/*
+ * This file is part of Embedded-IDE
+ *
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "appconfig.h"
+#include "childprocess.h"
+#include "compilecommanddatabase.h"
+
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPointer>
+#include <QRegularExpression>
+#include <QSaveFile>
+
+#include <QtConcurrent>
+
+#include <QtDebug>
+
+static const QString COMPILE_COMMANDS_FILE = "compile_commands.json";
+
+static const QStringList SOURCE_SUFFIXES = { "c", "cc", "cpp", "cxx", "c++", "C", "s", "S", "sx" };
+static const QStringList CXX_SUFFIXES = { "cc", "cpp", "cxx", "c++", "C", "hh", "hpp", "hxx", "h++" };
+
+// Options followed by a separated argument that is never a source file
+static const QStringList OPTIONS_WITH_VALUE = {
+    "-o", "-I", "-D", "-U", "-include", "-imacros", "-isystem", "-iquote", "-idirafter",
+    "-MF", "-MT", "-MQ", "-x", "-L", "-T", "-Xlinker", "-Xassembler", "-Xpreprocessor",
+};
+
+static const QRegularExpression COMPILER_RE(R"((?:^|[-/\\])(?:gcc|g\+\+|cc|c\+\+|clang|clang\+\+)(?:-[\d.]+)?(?:\.exe)?$)");
+static const QRegularExpression DIRECTORY_RE(R"(^\S*make(?:\[\d+\])?: (Entering|Leaving) directory [`'](.*)'$)");
+static const QRegularExpression ENV_ASSIGN_RE(R"(^[A-Za-z_]\w*=)");
+
+using ShellToken = QPair<QString, bool>; // token text, is an unquoted operator
+
+static QList<ShellToken> shellTokens(const QString& line)
+{
+    QList<ShellToken> tokens;
+    QString token;
+    bool inToken = false;
+    auto flush = [&tokens, &token, &inToken]() {
+        if (inToken)
+            tokens.append(ShellToken{ token, false });
+        token.clear();
+        inToken = false;
+    };
+    for (int i = 0; i < line.size(); i++) {
+        auto c = line.at(i);
+        if (c == ' ' || c == '\t') {
+            flush();
+        } else if (c == '\\') {
+            if (++i < line.size())
+                token += line.at(i);
+            inToken = true;
+        } else if (c == '\'') {
+            auto end = line.indexOf('\'', i + 1);
+            if (end == -1)
+                end = line.size();
+            token += line.midRef(i + 1, end - i - 1);
+            inToken = true;
+            i = end;
+        } else if (c == '"') {
+            for (i++; i < line.size() && line.at(i) != '"'; i++) {
+                if (line.at(i) == '\\' && i + 1 < line.size() && QString("\"\\$`").contains(line.at(i + 1)))
+                    i++;
+                token += line.at(i);
+            }
+            inToken = true;
+        } else if (c == ';' || c == '&' || c == '|') {
+            flush();
+            auto op = QString(c);
+            if (i + 1 < line.size() && line.at(i + 1) == c && c != ';')
+                op += line.at(++i);
+            tokens.append(ShellToken{ op, true });
+        } else {
+            token += c;
+            inToken = true;
+        }
+    }
+    flush();
+    return tokens;
+}
+
+static void appendCompilation(const QString& cwd, const QStringList& args, CompileCommandDatabase::CommandList *list)
+{
+    if (args.contains("-E") || args.contains("-M") || args.contains("-MM"))
+        return;
+    QStringList sources;
+    for (int i = 1; i < args.size(); i++) {
+        const auto& arg = args.at(i);
+        if (OPTIONS_WITH_VALUE.contains(arg))
+            i++;
+        else if (!arg.startsWith('-') && SOURCE_SUFFIXES.contains(QFileInfo(arg).suffix()))
+            sources.append(arg);
+    }
+    for (const auto& src: sources)
+        list->append(CompileCommandDatabase::Command{ cwd, QDir::cleanPath(QDir(cwd).absoluteFilePath(src)), args });
+}
+
+static void parseCommandLine(const QString& directory, const QString& line, CompileCommandDatabase::CommandList *list)
+{
+    QString cwd = directory;
+    QStringList args;
+    auto flush = [&cwd, &args, list]() {
+        while (!args.isEmpty() && ENV_ASSIGN_RE.match(args.first()).hasMatch())
+            args.removeFirst();
+        if (!args.isEmpty() && QFileInfo(args.first()).baseName() == "ccache")
+            args.removeFirst();
+        if (!args.isEmpty()) {
+            if (args.first() == "cd" && args.size() > 1)
+                cwd = QDir::cleanPath(QDir(cwd).absoluteFilePath(args.at(1)));
+            else if (COMPILER_RE.match(args.first()).hasMatch())
+                appendCompilation(cwd, args, list);
+        }
+        args.clear();
+    };
+    for (const auto& t: shellTokens(line)) {
+        if (t.second)
+            flush();
+        else
+            args.append(t.first);
+    }
+    flush();
+}
+
+static QJsonArray commandsToJson(const CompileCommandDatabase::CommandList& list)
+{
+    QJsonArray array;
+    for (const auto& c: list)
+        array.append(QJsonObject{
+                         { "directory", c.directory },
+                         { "file", c.file },
+                         { "arguments", QJsonArray::fromStringList(c.arguments) },
+                     });
+    return array;
+}
+
+static CompileCommandDatabase::CommandList commandsFromJson(const QJsonArray& array)
+{
+    CompileCommandDatabase::CommandList list;
+    for (const auto v: array) {
+        auto o = v.toObject();
+        QStringList args;
+        for (const auto a: o.value("arguments").toArray())
+            args.append(a.toString());
+        list.append(CompileCommandDatabase::Command{ o.value("directory").toString(), o.value("file").toString(), args });
+    }
+    return list;
+}
+
+static bool writeJson(const QString& path, const QJsonDocument& doc)
+{
+    QSaveFile f(path);
+    if (!f.open(QFile::WriteOnly))
+        return false;
+    f.write(doc.toJson(QJsonDocument::Compact));
+    return f.commit();
+}
+
+static QString cacheFileFor(const QString& projectDir)
+{
+    auto id = QCryptographicHash::hash(projectDir.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QDir(AppConfig::instance().cachePath()).absoluteFilePath(QString("%1.compiledb.json").arg(QString(id)));
+}
+
+bool CompileCommandDatabase::Command::isCXX() const
+{
+    return CXX_SUFFIXES.contains(QFileInfo(file).suffix()) || compiler().endsWith("++");
+}
+
+class CompileCommandDatabase::Priv_t
+{
+public:
+    CommandList commands;
+    QHash<QString, int> byFile;
+    QHash<QString, int> byDirectory;
+    QPointer<QProcess> process;
+    // Bumped by every update and clear, a make run from an older one drops its result
+    int generation{ 0 };
+
+    void setCommands(const CommandList& list) {
+        commands = list;
+        byFile.clear();
+        byDirectory.clear();
+        for (int i = 0; i < commands.size(); i++) {
+            const auto& file = commands.at(i).file;
+            byFile.insert(file, i);
+            auto dir = QFileInfo(file).absolutePath();
+            if (!byDirectory.contains(dir))
+                byDirectory.insert(dir, i);
+        }
+    }
+};
+
+CompileCommandDatabase::CompileCommandDatabase(QObject *parent) :
+    QObject(parent),
+    priv(std::make_unique<Priv_t>())
+{
+}
+
+CompileCommandDatabase::~CompileCommandDatabase()
+{
+}
+
+bool CompileCommandDatabase::isEmpty() const
+{
+    return priv->commands.isEmpty();
+}
+
+CompileCommandDatabase::CommandList CompileCommandDatabase::commands() const
+{
+    return priv->commands;
+}
+
+CompileCommandDatabase::Command CompileCommandDatabase::commandFor(const QString &file) const
+{
+    if (priv->commands.isEmpty())
+        return {};
+    QFileInfo info(file);
+    auto path = QDir::cleanPath(info.absoluteFilePath());
+    if (priv->byFile.contains(path))
+        return priv->commands.at(priv->byFile.value(path));
+    // Headers are not compiled alone, borrow the flags of a near translation unit
+    for (const auto& suffix: SOURCE_SUFFIXES) {
+        auto sibling = QDir::cleanPath(info.absoluteDir().absoluteFilePath(QString("%1.%2").arg(info.completeBaseName(), suffix)));
+        if (priv->byFile.contains(sibling))
+            return priv->commands.at(priv->byFile.value(sibling));
+    }
+    auto dir = info.absolutePath();
+    if (priv->byDirectory.contains(dir))
+        return priv->commands.at(priv->byDirectory.value(dir));
+    return priv->commands.first();
+}
+
+bool CompileCommandDatabase::exportTo(const QString &path) const
+{
+    return writeJson(path, QJsonDocument(commandsToJson(priv->commands)));
+}
+
+QStringList CompileCommandDatabase::tokenize(const QString &line)
+{
+    QStringList list;
+    for (const auto& t: shellTokens(line))
+        list.append(t.first);
+    return list;
+}
+
+CompileCommandDatabase::CommandList CompileCommandDatabase::parseMakeOutput(const QString &directory, QIODevice *in)
+{
+    CommandList list;
+    QStringList dirStack{ directory };
+    QString pending;
+    while (!in->atEnd()) {
+        auto line = QString::fromLocal8Bit(in->readLine());
+        while (line.endsWith('\n') || line.endsWith('\r'))
+            line.chop(1);
+        if (line.endsWith('\\')) {
+            line.chop(1);
+            pending += line;
+            continue;
+        }
+        line.prepend(pending);
+        pending.clear();
+        auto m = DIRECTORY_RE.match(line);
+        if (m.hasMatch()) {
+            if (m.captured(1) == "Entering")
+                dirStack.append(m.captured(2));
+            else if (dirStack.size() > 1)
+                dirStack.removeLast();
+            continue;
+        }
+        parseCommandLine(dirStack.last(), line, &list);
+    }
+    return list;
+}
+
+void CompileCommandDatabase::update(const QString &makefile, const QByteArray &makeDatabaseSignature)
+{
+    auto projectDir = QFileInfo(makefile).absolutePath();
+    auto cacheFile = cacheFileFor(projectDir);
+    auto signature = QString(makeDatabaseSignature.toHex());
+    auto generation = ++priv->generation;
+    auto cached = QJsonDocument::fromJson(AppConfig::readEntireTextFile(cacheFile)).object();
+    if (!signature.isEmpty() && cached.value("signature").toString() == signature) {
+        priv->setCommands(commandsFromJson(cached.value("commands").toArray()));
+        qDebug() << "compile database loaded from cache with" << priv->commands.size() << "entries";
+        emit updated();
+        return;
+    }
+
+    if (priv->process)
+        ChildProcess::cancel(priv->process);
+    auto& p = ChildProcess::create(this)
+            .makeDeleteLater()
+            .changeCWD(projectDir)
+            .setenv({ { "LC_ALL", "C" } })
+            .onFinished([this, projectDir, cacheFile, signature, generation](QProcess *make, int exitCode)
+    {
+        qDebug() << "make database dump exit with" << exitCode;
+        if (priv->generation != generation)
+            return;
+        auto output = make->readAllStandardOutput();
+        auto watcher = new QFutureWatcher<CommandList>(this);
+        connect(watcher, &QFutureWatcher<CommandList>::finished,
+                [this, watcher, projectDir, cacheFile, signature, generation]()
+        {
+            watcher->deleteLater();
+            if (priv->generation != generation)
+                return;
+            priv->setCommands(watcher->result());
+            writeJson(cacheFile, QJsonDocument(QJsonObject{
+                                                   { "signature", signature },
+                                                   { "commands", commandsToJson(priv->commands) },
+                                               }));
+            exportTo(QDir(projectDir).absoluteFilePath(COMPILE_COMMANDS_FILE));
+            qDebug() << "compile database updated with" << priv->commands.size() << "entries";
+            emit updated();
+        });
+        watcher->setFuture(QtConcurrent::run([projectDir, output]() {
+            QBuffer buffer;
+            buffer.setData(output);
+            buffer.open(QIODevice::ReadOnly);
+            return parseMakeOutput(projectDir, &buffer);
+        }));
+    }).onError([](QProcess *make, QProcess::ProcessError err) {
+        qDebug() << "make database error:" << make->errorString() << err;
+    });
+    priv->process = &p;
+    p.start("make", { "-B", "-n", "-k", "-w", "-f", makefile });
+}
+
+void CompileCommandDatabase::clear()
+{
+    if (priv->process)
+        ChildProcess::cancel(priv->process);
+    priv->generation++;
+    priv->setCommands({});
+}
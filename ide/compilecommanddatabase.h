@@ -0,0 +1,68 @@
+/*
+ * This file is part of Embedded-IDE
+ *
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef COMPILECOMMANDDATABASE_H
+#define COMPILECOMMANDDATABASE_H
+
+#include <QObject>
+#include <QStringList>
+
+#include <memory>
+
+class QIODevice;
+
+class CompileCommandDatabase : public QObject
+{
+    Q_OBJECT
+public:
+    struct Command {
+        QString directory;
+        QString file;
+        QStringList arguments;
+
+        bool isEmpty() const { return arguments.isEmpty(); }
+        QString compiler() const { return arguments.value(0); }
+        bool isCXX() const;
+    };
+    using CommandList = QList<Command>;
+
+    explicit CompileCommandDatabase(QObject *parent = nullptr);
+    virtual ~CompileCommandDatabase() override;
+
+    bool isEmpty() const;
+    CommandList commands() const;
+    Command commandFor(const QString& file) const;
+
+    bool exportTo(const QString& path) const;
+
+    static QStringList tokenize(const QString& line);
+    static CommandList parseMakeOutput(const QString& directory, QIODevice *in);
+
+signals:
+    void updated();
+
+public slots:
+    void update(const QString& makefile, const QByteArray& makeDatabaseSignature);
+    void clear();
+
+private:
+    class Priv_t;
+    std::unique_ptr<Priv_t> priv;
+};
+
+#endif // COMPILECOMMANDDATABASE_H
@@ -151,6 +151,8 @@ void ConfigWidget::save()
     conf.setEditorShowSpaces(ui->editorShowSpaces->isChecked());
     conf.setEditorFormatterStyle(ui->formatterStyle->currentText());
     conf.setEditorDetectIdent(ui->editorDetectIdent->isChecked());
+    conf.setEditorMemoryBudget(ui->editorMemoryBudget->value());
+    conf.setEditorFormatOnSave(ui->editorFormatOnSave->isChecked());
     conf.setTemplatesUrl(ui->templateSettings->repositoryUrl().toString());
     auto loggerFont = ui->loggerFontName->currentFont();
     loggerFont.setPointSize(ui->loggerFontSize->value());
@@ -172,6 +174,7 @@ void ConfigWidget::save()
     conf.setProjectTemplatesAutoUpdate(ui->autoUpdateProjectTmplates->isChecked());
     conf.setUseDevelopMode(ui->useDevelopment->isChecked());
     conf.setUseDarkStyle(ui->useDarkStyle->isChecked());
+    conf.setUseTextIndex(ui->useTextIndex->isChecked());
     conf.setLanguage(ui->languageList->currentText());
     conf.setNumberOfJobs(ui->numberOfJobs->value());
     conf.setNumberOfJobsOptimal(ui->numberOfJobsOptimal->isChecked());
@@ -191,6 +194,8 @@ void ConfigWidget::load()
     ui->editorReplaceTabs->setChecked(conf.editorTabsToSpaces());
     ui->editorTabWidth->setValue(conf.editorTabWidth());
     ui->editorDetectIdent->setChecked(conf.editorDetectIdent());
+    ui->editorMemoryBudget->setValue(conf.editorMemoryBudget());
+    ui->editorFormatOnSave->setChecked(conf.editorFormatOnSave());
     ui->editorShowSpaces->setChecked(conf.editorShowSpaces());
     ui->formatterStyle->setCurrentText(conf.editorFormatterStyle());
     ui->formatterExtra->setText(conf.editorFormatterExtra());
@@ -217,6 +222,7 @@ void ConfigWidget::load()
     ui->autoUpdateProjectTmplates->setChecked(conf.projectTemplatesAutoUpdate());
     ui->useDevelopment->setChecked(conf.useDevelopMode());
     ui->useDarkStyle->setChecked(conf.useDarkStyle());
+    ui->useTextIndex->setChecked(conf.useTextIndex());
     ui->languageList->setCurrentText(conf.language());
     ui->numberOfJobs->setValue(conf.numberOfJobs());
     ui->numberOfJobsOptimal->setChecked(conf.numberOfJobsOptimal());
@@ -18,8 +18,11 @@
  */
 #include "appconfig.h"
 #include "cpptexteditor.h"
+#include "fileclassifier.h"
 #include "filereferencesdialog.h"
 #include "icodemodelprovider.h"
+#include "replaceinfiles.h"
+#include "semantickeywords.h"
 #include "textmessagebrocker.h"
 
 #include <Qsci/qscilexercpp.h>
@@ -27,21 +30,30 @@
 
 #include <QMenu>
 
-#include <QMimeDatabase>
+#include <QPointer>
 #include <QRegularExpression>
 #include <QShortcut>
-#include <astyle.h>
+#include <QTimer>
+#include <QtConcurrent>
 
 #include <QtDebug>
-#include <astyle_main.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 
 static const QStringList C_CXX_EXTENSIONS = { "c", "cpp", "h", "hpp", "cc", "hh", "hxx", "cxx", "c++", "h++" };
 static const QStringList C_MIMETYPE = { "text/x-c++src", "text/x-c++hdr" };
 static const QStringList CXX_MIMETYPE = { "text/x-c", "text/x-csrc", "text/x-chdr" };
 
+static constexpr int INACTIVE_REGIONS_DELAY_MS = 300;
+static constexpr int INACTIVE_INDICATOR = 1;
+static constexpr int INACTIVE_TEXT_COLOR = 0x808080;
+static constexpr int CHANGED_LINE_MARKER = 20;
+
 class MyQsciLexerCPP: public QsciLexerCPP {
 private:
-    QLatin1String keywordList;
+    mutable SemanticKeywords::List keywordList;
 public:
     MyQsciLexerCPP(QObject *parent = nullptr, bool caseInsensitiveKeywords = false) :
         QsciLexerCPP(parent, caseInsensitiveKeywords)
@@ -58,21 +70,15 @@ public:
 
     const char *keywords(int set) const override
     {
-        //if (set == 5) {
-        //    updateKeywordList();
-        //    return keywordList.data();
-        //} else {
+        // Set 2 is drawn with the "TYPE WORD" style that every bundled theme defines
+        if (set == USER_TYPES_SET) {
+            keywordList = SemanticKeywords::instance().current();
+            return keywordList? keywordList->constData() : nullptr;
+        }
         return QsciLexerCPP::keywords(set);
-        //}
     }
 
-private:
-    void updateKeywordList() const {
-        auto c = qobject_cast<CodeTextEditor*>(editor());
-        if (c) {
-            // keywordList = c->keywordList();
-        }
-    }
+    static constexpr int USER_TYPES_SET = 2;
 };
 
 CPPTextEditor::CPPTextEditor(QWidget *parent) : CodeTextEditor(parent)
@@ -81,6 +87,30 @@ CPPTextEditor::CPPTextEditor(QWidget *parent) : CodeTextEditor(parent)
     setAutoCompletionSource(AcsNone);
     connect(new QShortcut(QKeySequence("Ctrl+Return"), this), &QShortcut::activated, this, &CPPTextEditor::findReference);
     connect(new QShortcut(QKeySequence("Ctrl+i"), this), &QShortcut::activated, this, &CPPTextEditor::formatCode);
+    connect(this, &QsciScintillaBase::SCN_MODIFIED,
+            [this](int position, int type, const char *text, int length, int linesAdded,
+                   int, int, int, int, int)
+    {
+        trackCompletionContext(position, type, text, length, linesAdded);
+        trackDirectiveChange(position, type, text, length, linesAdded);
+        trackChangedLines(position, type, length);
+    });
+    connect(&SemanticKeywords::instance(), &SemanticKeywords::changed, this, &CPPTextEditor::updateSemanticKeywords);
+
+    // Branches the compile flags leave out are drawn grey, the lexer does not track the preprocessor
+    SendScintilla(SCI_INDICSETSTYLE, INACTIVE_INDICATOR, INDIC_TEXTFORE);
+    SendScintilla(SCI_INDICSETFORE, INACTIVE_INDICATOR, INACTIVE_TEXT_COLOR);
+    inactiveTimer = new QTimer(this);
+    inactiveTimer->setSingleShot(true);
+    inactiveTimer->setInterval(INACTIVE_REGIONS_DELAY_MS);
+    connect(inactiveTimer, &QTimer::timeout, this, &CPPTextEditor::updateInactiveRegions);
+
+    // Invisible marker on lines edited since the last save, Scintilla moves it along with the text
+    markerDefine(QsciScintilla::Invisible, CHANGED_LINE_MARKER);
+    connect(this, &QsciScintilla::modificationChanged, [this](bool m) {
+        if (!m)
+            SendScintilla(SCI_MARKERDELETEALL, CHANGED_LINE_MARKER);
+    });
 }
 
 CPPTextEditor::~CPPTextEditor() = default;
@@ -92,6 +122,38 @@ bool CPPTextEditor::load(const QString &path)
     return CodeTextEditor::load(path);
 }
 
+bool CPPTextEditor::save(const QString &path)
+{
+    if (!CodeTextEditor::save(path))
+        return false;
+    if (codeModel())
+        codeModel()->startIndexingFile(path, [] {});
+    return true;
+}
+
+void CPPTextEditor::saveInBackground(const QString &path, SaveCallback_t done)
+{
+    QPointer<QsciScintilla> self(this);
+    auto write = [this, self, path, done]() {
+        if (!self) {
+            if (done)
+                done(false);
+            return;
+        }
+        CodeTextEditor::saveInBackground(path, [this, self, path, done](bool ok) {
+            if (ok && self && codeModel())
+                codeModel()->startIndexingFile(path, [] {});
+            if (done)
+                done(ok);
+        });
+    };
+    auto lines = AppConfig::instance().editorFormatOnSave()? changedLines() : CodeFormatter::LineRanges();
+    if (lines.isEmpty())
+        write();
+    else
+        formatRange(0, static_cast<int>(SendScintilla(SCI_GETLENGTH)), lines, write);
+}
+
 class CPPEditorCreator: public IDocumentEditorCreator
 {
 public:
@@ -129,13 +191,21 @@ IDocumentEditorCreator *CPPTextEditor::creator()
     return IDocumentEditorCreator::staticCreator<CPPEditorCreator>();
 }
 
+QStringList CPPTextEditor::sourceSuffixes()
+{
+    return C_CXX_EXTENSIONS;
+}
+
 void CPPTextEditor::findReference()
 {
     if (codeModel()) {
         auto word = wordUnderCursor();
 
-        codeModel()->referenceOf(word, [this, word](const ICodeModelProvider::FileReferenceList& refs)
+        QPointer<QsciScintilla> self(this);
+        codeModel()->referenceOf(word, [this, self](const ICodeModelProvider::FileReferenceList& refs)
         {
+            if (!self)
+                return;
             FileReferencesDialog d(refs, window());
             connect(&d, &FileReferencesDialog::itemClicked, [this](const QString& path, int line) {
                 qDebug() << "open" << path << "at" << line;
@@ -147,43 +217,101 @@ void CPPTextEditor::findReference()
         qDebug() << "No code model defined";
 }
 
-static STDCALL char* tempMemoryAllocation(unsigned long memoryNeeded)
+void CPPTextEditor::updateSemanticKeywords()
 {
-    char* buffer = new char[memoryNeeded];
-    return buffer;
+    auto list = SemanticKeywords::instance().current();
+    // Setting the list only invalidates the styling, Scintilla relexes up to the painted
+    // lines and leaves the rest, or the whole thing when hidden, until it gets shown
+    SendScintilla(SCI_SETKEYWORDS, static_cast<unsigned long>(MyQsciLexerCPP::USER_TYPES_SET - 1),
+                  list? list->constData() : "");
+    viewport()->update();
 }
 
-static STDCALL void tempError(int errorNumber, const char* errorMessage)
+void CPPTextEditor::showIncludeImpact()
 {
-    qDebug() << errorNumber << errorMessage;
-    TextMessageBrocker::instance().publish(TextMessages::STDERR_LOG, QString("%1: %2").arg(errorNumber).arg(errorMessage));
+    if (!codeModel())
+        return;
+    constexpr auto TOP_HEADERS = 10;
+    auto file = path();
+    auto affectedText = tr("%1 is seen by %2 translation units:");
+    auto costText = tr("%1 pulls %2 files (%3 KiB) into each of %4 translation units");
+    auto topText = tr("Most expensive headers:");
+    auto& brocker = TextMessageBrocker::instance();
+    codeModel()->affectedTranslationUnits(file, [file, affectedText, &brocker](const QStringList& units) {
+        brocker.publish(TextMessages::STDOUT_LOG, affectedText.arg(file).arg(units.size()));
+        for (const auto& unit: units)
+            brocker.publish(TextMessages::STDOUT_LOG, QString("  %1").arg(unit));
+    });
+    codeModel()->includeCosts([file, costText, topText, &brocker](const ICodeModelProvider::IncludeCostMap& costs) {
+        auto format = [&costText](const QString& header, const ICodeModelProvider::IncludeCost& c) {
+            return costText.arg(header).arg(c.files).arg(c.bytes / 1024).arg(c.translationUnits);
+        };
+        if (costs.contains(file))
+            brocker.publish(TextMessages::STDOUT_LOG, format(file, costs.value(file)));
+        // Bytes parsed across the whole build is what a header really costs
+        auto headers = costs.keys();
+        std::sort(headers.begin(), headers.end(), [&costs](const QString& a, const QString& b) {
+            const auto& ca = costs[a];
+            const auto& cb = costs[b];
+            return ca.bytes * qMax(ca.translationUnits, 1) > cb.bytes * qMax(cb.translationUnits, 1);
+        });
+        brocker.publish(TextMessages::STDOUT_LOG, topText);
+        for (const auto& header: headers.mid(0, TOP_HEADERS))
+            brocker.publish(TextMessages::STDOUT_LOG, QString("  %1").arg(format(header, costs.value(header))));
+    });
 }
 
 void CPPTextEditor::formatCode()
 {
-    int l;
-    int i;
-    getCursorPosition(&l, &i);
-    auto inText = selectedText();
-    if (inText.isEmpty()) {
-        selectAll();
-        inText = selectedText();
+    if (isReadOnly() || isLargeFileMode())
+        return;
+    // Selections grow to whole lines, AStyle needs them to keep the indentation right
+    int from = 0;
+    int to = static_cast<int>(SendScintilla(SCI_GETLENGTH));
+    if (hasSelectedText()) {
+        int lineFrom, indexFrom, lineTo, indexTo;
+        getSelection(&lineFrom, &indexFrom, &lineTo, &indexTo);
+        if (indexTo == 0 && lineTo > lineFrom)
+            lineTo--;
+        from = static_cast<int>(SendScintilla(SCI_POSITIONFROMLINE, static_cast<unsigned long>(lineFrom)));
+        auto end = SendScintilla(SCI_POSITIONFROMLINE, static_cast<unsigned long>(lineTo + 1));
+        if (end >= 0)
+            to = static_cast<int>(end);
     }
-    auto rawText = inText.toUtf8();
-    char* utf8In = rawText.data();
-    auto& cfg = AppConfig::instance();
-    const auto style = cfg.editorFormatterStyle();
-    const auto indentType = QString{cfg.editorTabsToSpaces()? "spaces" : "tab"};
-    const auto indentCount = QString("%1").arg(cfg.editorTabWidth());
-    auto extraAstyleParams = cfg.editorFormatterExtra();
-    char* utf8Out = AStyleMain(utf8In,
-                               QString("--style=%1 --indent=%2=%3 %4")
-                                   .arg(style, indentType, indentCount, extraAstyleParams).toLatin1().data(),
-                               tempError,
-                               tempMemoryAllocation);
-    replaceSelectedText(QString::fromUtf8(utf8Out));
-    setCursorPosition(l, i);
-    ensureLineVisible(l);
+    formatRange(from, to, {}, {});
+}
+
+void CPPTextEditor::formatRange(int from, int to, const CodeFormatter::LineRanges &lines, std::function<void ()> done)
+{
+    auto buffer = static_cast<const char*>(SendScintillaPtrResult(SCI_GETCHARACTERPOINTER));
+    auto revision = textRevision();
+    // Not owned by the editor, a save waiting on done() must hear back even if it gets closed
+    QPointer<QsciScintilla> self(this);
+    auto watcher = new QFutureWatcher<CodeFormatter::Result>();
+    connect(watcher, &QFutureWatcher<CodeFormatter::Result>::finished, [this, self, watcher, from, revision, done]() {
+        auto result = watcher->result();
+        watcher->deleteLater();
+        if (!self || formatWatcher != watcher) {
+            if (done)
+                done();
+            return;
+        }
+        if (!result.error.isEmpty())
+            TextMessageBrocker::instance().publish(TextMessages::STDERR_LOG, result.error);
+        // Typing while AStyle ran makes the offsets stale, the user edit wins
+        if (revision == textRevision() && !result.edits.isEmpty()) {
+            int line, index;
+            getCursorPosition(&line, &index);
+            ReplaceInFiles::replaceTargets(this, from, result.edits);
+            setCursorPosition(line, index);
+            ensureLineVisible(line);
+        }
+        if (done)
+            done();
+    });
+    formatWatcher = watcher;
+    watcher->setFuture(QtConcurrent::run(&CodeFormatter::edits, QByteArray(buffer + from, to - from),
+                                         CodeFormatter::options(), lines));
 }
 
 QMenu *CPPTextEditor::createContextualMenu()
@@ -193,23 +321,35 @@ QMenu *CPPTextEditor::createContextualMenu()
                     tr("Find Reference"),
                     this, &CPPTextEditor::findReference)
             ->setShortcut(QKeySequence("CTRL+ENTER"));
+    menu->addAction(tr("Include Impact"), this, &CPPTextEditor::showIncludeImpact);
     return menu;
 }
 
 void CPPTextEditor::triggerAutocompletion()
 {
     if (codeModel()) {
+        auto position = SendScintilla(SCI_GETCURRENTPOS);
+        auto start = SendScintilla(SCI_WORDSTARTPOSITION, static_cast<unsigned long>(position), true);
         int line;
         int index;
-        getCursorPosition(&line, &index);
+        lineIndexFromPosition(static_cast<int>(start), &line, &index);
+        auto prefix = text(static_cast<int>(start), static_cast<int>(position));
+        if (start != completionAnchor) {
+            completionAnchor = start;
+            completionRevision++;
+        }
+        auto length = static_cast<int>(SendScintilla(SCI_GETLENGTH));
+        auto buffer = static_cast<const char*>(SendScintillaPtrResult(SCI_GETCHARACTERPOINTER));
+        QPointer<QsciScintilla> self(this);
         codeModel()->completionAt(
-            ICodeModelProvider::FileReference{ path(), line, index, QString() }, text(),
-            [this](const QStringList& completions)
+            ICodeModelProvider::FileReference{ path(), line, index, QString() },
+            prefix, completionRevision, QByteArray::fromRawData(buffer, length),
+            [this, self](const QStringList& completions)
         {
-            auto w = wordUnderCursor();
-            auto filtered = completions.filter(QRegularExpression(QString(R"(^%1)").arg(w)));
-            if (!filtered.isEmpty()) {
-                showUserList(1, filtered);
+            if (!self)
+                return;
+            if (!completions.isEmpty()) {
+                showUserList(1, completions);
             } else // Fallback autocompletion
                 CodeTextEditor::triggerAutocompletion();
         });
@@ -218,9 +358,143 @@ void CPPTextEditor::triggerAutocompletion()
     }
 }
 
+void CPPTextEditor::trackCompletionContext(int position, int type, const char *text, int length, int linesAdded)
+{
+    if (!(type & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)))
+        return;
+    // Typing or erasing inside the word under completion keeps the cached context,
+    // any other change invalidates it
+    auto isWordEdit = [this, position, text, length, linesAdded]() {
+        if (completionAnchor < 0 || position < completionAnchor || linesAdded != 0 || !text)
+            return false;
+        auto wordEnd = SendScintilla(SCI_WORDENDPOSITION, static_cast<unsigned long>(completionAnchor), true);
+        if (position > wordEnd)
+            return false;
+        for (int i = 0; i < length; i++)
+            if (!(std::isalnum(static_cast<unsigned char>(text[i])) || text[i] == '_'))
+                return false;
+        return true;
+    };
+    if (!isWordEdit()) {
+        completionAnchor = -1;
+        completionRevision++;
+    }
+}
+
+void CPPTextEditor::trackDirectiveChange(int position, int type, const char *text, int length, int linesAdded)
+{
+    if (!(type & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)) || isLargeFileMode())
+        return;
+    // Plain edits keep the dimmed ranges in place, only directives move the branches
+    auto touchesDirective = [this, position, text, length]() {
+        if (text && std::memchr(text, '#', static_cast<size_t>(length)))
+            return true;
+        auto line = SendScintilla(SCI_LINEFROMPOSITION, static_cast<unsigned long>(position));
+        auto indent = SendScintilla(SCI_GETLINEINDENTPOSITION, static_cast<unsigned long>(line));
+        return SendScintilla(SCI_GETCHARAT, static_cast<unsigned long>(indent)) == '#';
+    };
+    if (touchesDirective()) {
+        structureRevision++;
+        inactiveTimer->start();
+    } else if (linesAdded != 0) {
+        structureRevision++;
+    }
+}
+
+void CPPTextEditor::updateInactiveRegions()
+{
+    if (!codeModel() || isLargeFileMode() || path().isEmpty())
+        return;
+    QPointer<QsciScintilla> self(this);
+    codeModel()->macrosFor(path(), [this, self](bool known, const ICodeModelProvider::MacroMap& macros) {
+        if (!self)
+            return;
+        inactiveMacros = macros;
+        if (!known) {
+            applyInactiveRegions({});
+            return;
+        }
+        auto length = static_cast<int>(SendScintilla(SCI_GETLENGTH));
+        auto buffer = static_cast<const char*>(SendScintillaPtrResult(SCI_GETCHARACTERPOINTER));
+        auto revision = structureRevision;
+        auto watcher = new QFutureWatcher<PreprocessorRegions::LineRanges>(this);
+        connect(watcher, &QFutureWatcher<PreprocessorRegions::LineRanges>::finished, [this, watcher, revision]() {
+            if (inactiveWatcher == watcher) {
+                // Line numbers are stale once lines came or went, evaluate again
+                if (revision == structureRevision)
+                    applyInactiveRegions(watcher->result());
+                else
+                    inactiveTimer->start();
+            }
+            watcher->deleteLater();
+        });
+        inactiveWatcher = watcher;
+        watcher->setFuture(QtConcurrent::run(&PreprocessorRegions::inactiveLines, QByteArray(buffer, length), macros));
+    });
+}
+
+void CPPTextEditor::trackChangedLines(int position, int type, int length)
+{
+    if (!(type & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)) || isLargeFileMode())
+        return;
+    // Loading and reloading run with undo collection off, those are not user edits
+    if (!SendScintilla(SCI_GETUNDOCOLLECTION))
+        return;
+    auto first = SendScintilla(SCI_LINEFROMPOSITION, static_cast<unsigned long>(position));
+    auto last = first;
+    if (type & SC_MOD_INSERTTEXT)
+        last = SendScintilla(SCI_LINEFROMPOSITION, static_cast<unsigned long>(position + length));
+    for (auto line = first; line <= last; line++)
+        if (!(SendScintilla(SCI_MARKERGET, static_cast<unsigned long>(line)) & (1 << CHANGED_LINE_MARKER)))
+            SendScintilla(SCI_MARKERADD, static_cast<unsigned long>(line), CHANGED_LINE_MARKER);
+}
+
+CodeFormatter::LineRanges CPPTextEditor::changedLines() const
+{
+    CodeFormatter::LineRanges ranges;
+    auto line = SendScintilla(SCI_MARKERNEXT, 0ul, 1 << CHANGED_LINE_MARKER);
+    while (line >= 0) {
+        if (!ranges.isEmpty() && ranges.last().second + 1 == line)
+            ranges.last().second = static_cast<int>(line);
+        else
+            ranges.append({ static_cast<int>(line), static_cast<int>(line) });
+        line = SendScintilla(SCI_MARKERNEXT, static_cast<unsigned long>(line + 1), 1 << CHANGED_LINE_MARKER);
+    }
+    return ranges;
+}
+
+void CPPTextEditor::applyInactiveRegions(const PreprocessorRegions::LineRanges &ranges)
+{
+    auto length = SendScintilla(SCI_GETLENGTH);
+    SendScintilla(SCI_SETINDICATORCURRENT, INACTIVE_INDICATOR);
+    SendScintilla(SCI_INDICATORCLEARRANGE, 0, length);
+    for (const auto& r: ranges) {
+        auto start = SendScintilla(SCI_POSITIONFROMLINE, static_cast<unsigned long>(r.first));
+        auto end = SendScintilla(SCI_POSITIONFROMLINE, static_cast<unsigned long>(r.second + 1));
+        if (start < 0)
+            break;
+        if (end < 0)
+            end = length;
+        SendScintilla(SCI_INDICATORFILLRANGE, static_cast<unsigned long>(start), end - start);
+    }
+}
+
+void CPPTextEditor::focusInEvent(QFocusEvent *event)
+{
+    CodeTextEditor::focusInEvent(event);
+    // The compile database or the toolchain probe may have changed the macros meanwhile
+    if (codeModel() && !isLargeFileMode()) {
+        QPointer<QsciScintilla> self(this);
+        codeModel()->macrosFor(path(), [this, self](bool known, const ICodeModelProvider::MacroMap& macros) {
+            if (self && known && macros != inactiveMacros)
+                inactiveTimer->start();
+        });
+    }
+}
+
 QsciLexer *CPPTextEditor::lexerFromFile(const QString &name)
 {
     Q_UNUSED(name);
-    setProperty("isCXX", CPPEditorCreator::in(QMimeDatabase().mimeTypeForFile(name), CXX_MIMETYPE));
+    setProperty("isCXX", CPPEditorCreator::in(FileClassifier::classify(name).mime, CXX_MIMETYPE));
     return new MyQsciLexerCPP(this);
 }
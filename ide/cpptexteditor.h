@@ -20,6 +20,8 @@
 #define CPPTEXTEDITOR_H
 
 #include "codetexteditor.h"
+#include "codeformatter.h"
+#include "preprocessorregions.h"
 
 class ICodeModelProvider;
 
@@ -30,17 +32,43 @@ public:
     virtual ~CPPTextEditor() override;
 
     bool load(const QString &path) override;
+    bool save(const QString &path) override;
+    void saveInBackground(const QString &path, SaveCallback_t done) override;
 
     static IDocumentEditorCreator *creator();
+    // Suffixes of the C and C++ files this editor opens
+    static QStringList sourceSuffixes();
 
 private slots:
     void findReference();
     void formatCode();
+    void showIncludeImpact();
+    void updateSemanticKeywords();
+    void updateInactiveRegions();
 
 protected:
     QMenu *createContextualMenu() override;
     void triggerAutocompletion() override;
     QsciLexer *lexerFromFile(const QString &name) override;
+    void focusInEvent(QFocusEvent *event) override;
+
+private:
+    void trackCompletionContext(int position, int type, const char *text, int length, int linesAdded);
+    void trackDirectiveChange(int position, int type, const char *text, int length, int linesAdded);
+    void applyInactiveRegions(const PreprocessorRegions::LineRanges& ranges);
+    void trackChangedLines(int position, int type, int length);
+    CodeFormatter::LineRanges changedLines() const;
+    void formatRange(int from, int to, const CodeFormatter::LineRanges& lines, std::function<void ()> done);
+
+    long completionAnchor = -1;
+    int completionRevision = 0;
+
+    QTimer *inactiveTimer = nullptr;
+    QPointer<QFutureWatcher<PreprocessorRegions::LineRanges>> inactiveWatcher;
+    PreprocessorRegions::MacroMap inactiveMacros;
+    int structureRevision = 0; // directives edited or lines added or removed
+
+    QPointer<QFutureWatcher<CodeFormatter::Result>> formatWatcher;
 };
 
 #endif // CPPTEXTEDITOR_H
@@ -35,14 +35,23 @@
 #include <QComboBox>
 #include <QDir>
 #include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QLabel>
 #include <QMimeDatabase>
+#include <QSaveFile>
 #include <QShortcut>
+#include <QSplitter>
 #include <QSortFilterProxyModel>
 #include <QStackedLayout>
+#include <QTimer>
 
 #include <QtDebug>
 
+static constexpr int EXTERNAL_CHANGE_DELAY_MS = 300;
+
 static QString absoluteTo(const QString& path, const QString& file) {
     return QFileInfo(file).isAbsolute()? file : QDir(path).absoluteFilePath(file);
 }
@@ -53,6 +62,35 @@ public:
     QStackedLayout *stack = nullptr;
     QHash<QString, IDocumentEditor*> mapedWidgets;
     const ProjectManager *projectManager = nullptr;
+    QFileSystemWatcher *watcher = nullptr;
+    QTimer *changeTimer = nullptr;
+    QSet<QString> changedFiles;
+
+    // Entries listed in the selector without an editor, restored from a session or
+    // evicted from the pool, the editor is built again when activated
+    struct Placeholder {
+        QPoint cursor;
+        int scrollLine;
+    };
+    QHash<QString, Placeholder> placeholders;
+    QStringList recentlyUsed; // most recently activated first
+    // Documents shown in several panes live in a splitter, that is what the stack holds
+    QHash<QString, QSplitter*> splits;
+
+    QWidget *page(IDocumentEditor *iface) const {
+        auto splitter = splits.value(iface->path());
+        return splitter? splitter : iface->widget();
+    }
+
+    void removePage(IDocumentEditor *iface) {
+        auto splitter = splits.take(iface->path());
+        if (splitter) {
+            stack->removeWidget(splitter);
+            splitter->deleteLater();
+        } else
+            stack->removeWidget(iface->widget());
+        iface->widget()->deleteLater();
+    }
 };
 
 DocumentManager::DocumentManager(QWidget *parent) :
@@ -80,7 +118,21 @@ DocumentManager::DocumentManager(QWidget *parent) :
     };
     shCut("CTRL+SHIFT+X", &DocumentManager::closeCurrent);
     shCut("CTRL+SHIFT+R", &DocumentManager::reloadDocumentCurrent);
+    shCut("CTRL+SHIFT+H", [this]() { splitCurrent(Qt::Horizontal); });
+    shCut("CTRL+SHIFT+V", [this]() { splitCurrent(Qt::Vertical); });
+    shCut("CTRL+SHIFT+W", &DocumentManager::unsplitCurrent);
     // SHCUT("CTRL+S", &DocumentManager::saveCurrent);
+
+    // Generators tend to rewrite a file several times in a row, settle first
+    priv->watcher = new QFileSystemWatcher(this);
+    priv->changeTimer = new QTimer(this);
+    priv->changeTimer->setSingleShot(true);
+    priv->changeTimer->setInterval(EXTERNAL_CHANGE_DELAY_MS);
+    connect(priv->watcher, &QFileSystemWatcher::fileChanged, [this](const QString& path) {
+        priv->changedFiles.insert(path);
+        priv->changeTimer->start();
+    });
+    connect(priv->changeTimer, &QTimer::timeout, this, &DocumentManager::reloadChangedDocuments);
 }
 
 DocumentManager::~DocumentManager()
@@ -133,14 +185,15 @@ QStringList DocumentManager::unsavedDocuments() const
     return unsaved;
 }
 
+// Restored and evicted documents without an editor yet count as open
 QStringList DocumentManager::documents() const
 {
-    return priv->mapedWidgets.keys();
+    return priv->mapedWidgets.keys() + priv->placeholders.keys();
 }
 
 int DocumentManager::documentCount() const
 {
-    return priv->mapedWidgets.count();
+    return priv->mapedWidgets.count() + priv->placeholders.count();
 }
 
 QString DocumentManager::documentCurrent() const
@@ -207,12 +260,21 @@ IDocumentEditor *DocumentManager::openDocument(const QString &filePath)
                     emit documentPositionModified(ed->path(), line, col);
                 });
                 item->setDocumentManager(this);
+                priv->watcher->addPath(path);
+                if (priv->placeholders.contains(path)) {
+                    auto placeholder = priv->placeholders.take(path);
+                    item->setCursor(placeholder.cursor);
+                    item->setScrollLine(placeholder.scrollLine);
+                }
             }
         }
     } else
         widget = item->widget();
     if (widget) {
-        priv->stack->setCurrentWidget(widget);
+        priv->stack->setCurrentWidget(priv->page(item));
+        priv->recentlyUsed.removeOne(path);
+        priv->recentlyUsed.prepend(path);
+        evictDocuments();
         emit documentFocushed(path);
     } else
         emit documentNotFound(path);
@@ -233,19 +295,29 @@ bool DocumentManager::closeDocument(const QString &filePath)
     // Cannot save due not name on path
     if (path.isEmpty())
         return true;
+    priv->recentlyUsed.removeOne(path);
+    if (priv->placeholders.remove(path)) {
+        if (priv->combo) {
+            int idx = priv->combo->findData(path);
+            if (idx != -1)
+                priv->combo->removeItem(idx);
+        }
+        emit documentClosed(path);
+        return true;
+    }
     // Cannot save due not in map (not widget interface registered)
     auto iface = priv->mapedWidgets.value(path);
     if (!iface)
         return true;
     if (iface->widget()->close()) {
-        priv->stack->removeWidget(iface->widget());
         if (priv->combo) {
             int idx = priv->combo->findData(iface->path());
             if (idx != -1)
                 priv->combo->removeItem(idx);
         }
-        iface->widget()->deleteLater();
+        priv->removePage(iface);
         priv->mapedWidgets.remove(path);
+        priv->watcher->removePath(path);
         emit documentClosed(path);
         return true;
     }
@@ -254,7 +326,7 @@ bool DocumentManager::closeDocument(const QString &filePath)
 
 bool DocumentManager::closeAll()
 {
-    const auto keys = priv->mapedWidgets.keys();
+    const auto keys = priv->mapedWidgets.keys() + priv->placeholders.keys();
     for(const auto& path: keys)
         if (!closeDocument(path))
             return false;
@@ -287,14 +359,46 @@ void DocumentManager::saveDocument(const QString &path)
     auto iface = priv->mapedWidgets.value(absoluteTo(priv->projectManager->projectPath(), path));
     if (!iface)
         return;
-    iface->save(iface->path());
+    iface->saveInBackground(iface->path(), {});
+}
+
+void DocumentManager::saveDocuments(const QStringList &list)
+{
+    // Done in place, callers close the documents right after
+    for (const auto& path: list) {
+        auto iface = priv->mapedWidgets.value(absoluteTo(priv->projectManager->projectPath(), path));
+        if (iface)
+            iface->save(iface->path());
+    }
+}
+
+void DocumentManager::saveDocuments(const QStringList &list, const std::function<void (bool)> &done)
+{
+    QList<IDocumentEditor*> editors;
+    for (const auto& path: list) {
+        auto iface = priv->mapedWidgets.value(absoluteTo(priv->projectManager->projectPath(), path));
+        if (iface)
+            editors.append(iface);
+    }
+    if (editors.isEmpty()) {
+        if (done)
+            done(true);
+        return;
+    }
+    auto pending = std::make_shared<int>(editors.size());
+    auto allOk = std::make_shared<bool>(true);
+    for (auto iface: editors) {
+        iface->saveInBackground(iface->path(), [pending, allOk, done](bool ok) {
+            *allOk = *allOk && ok;
+            if (--*pending == 0 && done)
+                done(*allOk);
+        });
+    }
 }
 
 void DocumentManager::saveAll()
 {
-    const auto keys = priv->mapedWidgets.keys();
-    for(const auto& path: keys)
-        saveDocument(path);
+    saveDocuments(priv->mapedWidgets.keys(), {});
 }
 
 void DocumentManager::reloadDocument(const QString &path)
@@ -307,6 +411,159 @@ void DocumentManager::reloadDocument(const QString &path)
     iface->reload();
 }
 
+void DocumentManager::saveSession(const QString &sessionFile) const
+{
+    QJsonArray list;
+    auto append = [&list](const QString& path, const QPoint& cursor, int scrollLine) {
+        list.append(QJsonObject{
+            { "path", path },
+            { "line", cursor.y() },
+            { "column", cursor.x() },
+            { "scrollLine", scrollLine },
+        });
+    };
+    for (auto it = priv->mapedWidgets.cbegin(); it != priv->mapedWidgets.cend(); ++it) {
+        // cursor() counts lines from 0, setCursor() from 1
+        auto cursor = it.value()->cursor();
+        append(it.key(), QPoint(cursor.x(), cursor.y() + 1), it.value()->scrollLine());
+    }
+    for (auto it = priv->placeholders.cbegin(); it != priv->placeholders.cend(); ++it)
+        append(it.key(), it->cursor, it->scrollLine);
+    QJsonObject session{ { "current", documentCurrent() }, { "documents", list } };
+    QSaveFile f(sessionFile);
+    if (f.open(QFile::WriteOnly)) {
+        f.write(QJsonDocument(session).toJson(QJsonDocument::Compact));
+        f.commit();
+    }
+}
+
+void DocumentManager::restoreSession(const QString &sessionFile)
+{
+    QFile f(sessionFile);
+    if (!f.open(QFile::ReadOnly))
+        return;
+    auto session = QJsonDocument::fromJson(f.readAll()).object();
+    // Only selector entries here, editors are built when an entry is first activated
+    {
+        QSignalBlocker blocker(priv->combo);
+        for (const auto& v: session.value("documents").toArray()) {
+            auto o = v.toObject();
+            auto path = o.value("path").toString();
+            if (path.isEmpty() || priv->mapedWidgets.contains(path) || !QFileInfo(path).isFile())
+                continue;
+            priv->placeholders.insert(path, Priv_t::Placeholder{
+                QPoint(o.value("column").toInt(), o.value("line").toInt()),
+                o.value("scrollLine").toInt()
+            });
+            if (priv->combo && priv->combo->findData(path) == -1)
+                priv->combo->addItem(FileSystemManager::iconForFile(QFileInfo(path)), QFileInfo(path).fileName(), path);
+        }
+        if (priv->combo)
+            priv->combo->model()->sort(0);
+    }
+    auto current = session.value("current").toString();
+    // A current document gone from disk falls back to another restored one, the
+    // selector and the document buttons follow the focused document
+    if (!priv->placeholders.contains(current) && !priv->placeholders.isEmpty())
+        current = priv->placeholders.keys().first();
+    if (priv->placeholders.contains(current))
+        openDocument(current);
+}
+
+void DocumentManager::splitCurrent(Qt::Orientation orientation)
+{
+    auto iface = documentEditorCurrent();
+    if (!iface)
+        return;
+    auto path = iface->path();
+    auto splitter = priv->splits.value(path);
+    if (!splitter) {
+        auto widget = iface->widget();
+        splitter = new QSplitter(orientation, this);
+        splitter->setWindowFilePath(path);
+        splitter->setChildrenCollapsible(false);
+        priv->splits.insert(path, splitter);
+        priv->stack->addWidget(splitter);
+        priv->stack->setCurrentWidget(splitter);
+        priv->stack->removeWidget(widget);
+        splitter->addWidget(widget);
+    }
+    auto view = iface->createSplitView(splitter);
+    if (!view) {
+        TextMessageBrocker::instance().publish(TextMessages::STDERR_LOG, tr("%1 cannot be split").arg(path));
+        return;
+    }
+    splitter->setOrientation(orientation);
+    splitter->addWidget(view);
+    // Give every pane the same share of the page
+    splitter->setSizes(QVector<int>(splitter->count(), 1).toList());
+    view->setFocus();
+}
+
+void DocumentManager::unsplitCurrent()
+{
+    auto iface = documentEditorCurrent();
+    if (!iface)
+        return;
+    auto splitter = priv->splits.value(iface->path());
+    if (!splitter)
+        return;
+    for (int i = splitter->count() - 1; i >= 0; i--)
+        if (splitter->widget(i) != iface->widget())
+            delete splitter->widget(i);
+    iface->widget()->setFocus();
+}
+
+void DocumentManager::evictDocuments()
+{
+    const qint64 budget = qint64(AppConfig::instance().editorMemoryBudget()) * 1024 * 1024;
+    qint64 used = 0;
+    for (const auto& iface: priv->mapedWidgets)
+        used += iface->memoryUsage();
+    const auto current = documentCurrent();
+    for (int i = priv->recentlyUsed.size() - 1; i >= 0 && used > budget; i--) {
+        const auto path = priv->recentlyUsed.at(i);
+        auto iface = priv->mapedWidgets.value(path);
+        if (!iface || path == current || iface->isModified() || iface->isSaving())
+            continue;
+        auto size = iface->memoryUsage();
+        if (size == 0)
+            continue;
+        // cursor() counts lines from 0, setCursor() from 1
+        auto cursor = iface->cursor();
+        priv->placeholders.insert(path, Priv_t::Placeholder{
+            QPoint(cursor.x(), cursor.y() + 1), iface->scrollLine()
+        });
+        priv->removePage(iface);
+        priv->mapedWidgets.remove(path);
+        priv->watcher->removePath(path);
+        priv->recentlyUsed.removeAt(i);
+        used -= size;
+    }
+}
+
+void DocumentManager::reloadChangedDocuments()
+{
+    const auto changed = priv->changedFiles;
+    priv->changedFiles.clear();
+    for (const auto& path: changed) {
+        auto iface = priv->mapedWidgets.value(path, nullptr);
+        if (!iface || !QFileInfo::exists(path))
+            continue;
+        // Replaced files, as atomic saves do, drop out of the watch list
+        if (!priv->watcher->files().contains(path))
+            priv->watcher->addPath(path);
+        if (iface->isSaving())
+            continue;
+        if (iface->isModified()) {
+            TextMessageBrocker::instance().publish(TextMessages::STDERR_LOG,
+                tr("%1 changed on disk, not reloaded because it has unsaved changes").arg(path));
+            continue;
+        }
+        iface->reload();
+    }
+}
+
 void DocumentManager::focusInEvent(QFocusEvent *event)
 {
     Q_UNUSED(event);
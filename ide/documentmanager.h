@@ -21,6 +21,7 @@
 
 #include <QWidget>
 
+#include <functional>
 #include <memory>
 
 class IDocumentEditor;
@@ -46,6 +47,14 @@ public:
 
     void setProjectManager(const ProjectManager *projectManager);
 
+    // Open documents with cursor and scroll position, restored as selector entries that
+    // build their editor on first activation
+    void saveSession(const QString& sessionFile) const;
+    void restoreSession(const QString& sessionFile);
+
+    // Saves every document on its own worker, done runs when the last one is written
+    void saveDocuments(const QStringList& list, const std::function<void (bool ok)>& done);
+
 signals:
     void documentFocushed(const QString& path);
     void documentNotFound(const QString& path);
@@ -61,16 +70,26 @@ public slots:
     bool closeAll();
     bool aboutToCloseAll();
     void saveDocument(const QString& path);
-    void saveDocuments(const QStringList& list) { for(const auto& a: list) saveDocument(a); }
+    void saveDocuments(const QStringList& list);
     void saveCurrent() { saveDocument(documentCurrent()); }
     void saveAll();
     void reloadDocument(const QString& path);
     void reloadDocumentCurrent() { reloadDocument(documentCurrent()); }
+    // Splits add panes showing the current document, sharing its text and undo history
+    void splitCurrent(Qt::Orientation orientation);
+    void unsplitCurrent();
 
 protected:
     void focusInEvent(QFocusEvent *event) override;
 
+private slots:
+    void reloadChangedDocuments();
+
 private:
+    // Unloads clean documents out of view, least recently used first, until the open
+    // editors fit in the configured memory budget
+    void evictDocuments();
+
     class Priv_t;
     std::unique_ptr<Priv_t> priv;
 };
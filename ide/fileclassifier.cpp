@@ -0,0 +1,113 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "fileclassifier.h"
+#include "filesystemmanager.h"
+
+#include <QFile>
+#include <QHash>
+#include <QMimeDatabase>
+#include <QMutex>
+#include <QMutexLocker>
+
+static constexpr int SNIFF_SIZE = 512;
+
+static QString sniff(const QFileInfo& info)
+{
+    if (info.size() == 0)
+        return "empty";
+    QFile f(info.absoluteFilePath());
+    if (!f.open(QFile::ReadOnly))
+        return "unreadable";
+    auto head = f.read(SNIFF_SIZE);
+    if (head.contains('\0'))
+        return "binary";
+    // Scripts without suffix are told apart by their interpreter
+    if (head.startsWith("#!"))
+        return QString::fromUtf8(head.left(head.indexOf('\n')));
+    return "text";
+}
+
+static QString iconPathFor(const QMimeType& t)
+{
+    if (!t.isValid())
+        return QString();
+    auto resName = FileSystemManager::mimeIconPath(t.iconName());
+    if (QFile(resName).exists())
+        return resName;
+    resName = FileSystemManager::mimeIconPath(t.genericIconName());
+    if (QFile(resName).exists())
+        return resName;
+    return QString();
+}
+
+struct NameKey {
+    QString key;
+    bool needsContent; // the name matches no MIME type or several of them
+};
+
+// Names globbing like any other with their suffix share the suffix key, the
+// ones with patterns of their own (CMakeLists.txt, Makefile.in...) keep theirs
+static NameKey nameKey(const QFileInfo& info)
+{
+    QMimeDatabase db;
+    auto name = info.fileName();
+    auto suffix = info.suffix();
+    auto byName = db.mimeTypesForFileName(name);
+    auto bySuffix = suffix.isEmpty()? byName : db.mimeTypesForFileName("file." + suffix);
+    auto key = suffix.isEmpty() || byName != bySuffix? "=" + name : "." + suffix;
+    return { key, byName.size() != 1 };
+}
+
+FileClassifier::Class FileClassifier::classify(const QFileInfo &info)
+{
+    static QMutex mutex;
+    static QHash<QString, NameKey> nameKeys;
+    static QHash<QString, Class> known;
+
+    auto name = info.fileName();
+    NameKey byName;
+    {
+        QMutexLocker lock(&mutex);
+        byName = nameKeys.value(name);
+    }
+    if (byName.key.isEmpty()) {
+        byName = nameKey(info);
+        QMutexLocker lock(&mutex);
+        nameKeys.insert(name, byName);
+    }
+    // Only names that do not tell the type cost a read
+    auto key = byName.needsContent? QString("%1\n%2").arg(byName.key, sniff(info)) : byName.key;
+    {
+        QMutexLocker lock(&mutex);
+        auto it = known.constFind(key);
+        if (it != known.constEnd())
+            return it.value();
+    }
+
+    QMimeDatabase db;
+    Class c;
+    c.key = key;
+    c.mime = db.mimeTypeForFile(info);
+    c.suffixes = QStringList(info.suffix()) << c.mime.suffixes();
+    c.iconPath = iconPathFor(c.mime);
+
+    QMutexLocker lock(&mutex);
+    known.insert(key, c);
+    return c;
+}
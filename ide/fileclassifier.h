@@ -0,0 +1,45 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef FILECLASSIFIER_H
+#define FILECLASSIFIER_H
+
+#include <QFileInfo>
+#include <QMimeType>
+#include <QStringList>
+
+// What a file is, for picking its editor, lexer and icon. Results are memoized by
+// suffix, or by name when the name has patterns of its own, plus a sniff of the
+// first bytes when the name alone is ambiguous, so opening a file costs at most one
+// MIME database lookup per kind of file
+class FileClassifier
+{
+public:
+    struct Class {
+        QString key;
+        QMimeType mime;
+        QStringList suffixes; // the file's own first, then the ones of its MIME type
+        QString iconPath; // bundled icon, empty when none matches
+    };
+
+    // Safe to call from any thread, the file model asks for icons from its gatherer
+    static Class classify(const QFileInfo& info);
+    static Class classify(const QString& path) { return classify(QFileInfo(path)); }
+};
+
+#endif // FILECLASSIFIER_H
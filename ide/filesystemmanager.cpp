@@ -17,6 +17,7 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include "appconfig.h"
+#include "fileclassifier.h"
 #include "filesystemmanager.h"
 
 #include <QCheckBox>
@@ -28,7 +29,6 @@
 #include <QInputDialog>
 #include <QMenu>
 #include <QMessageBox>
-#include <QMimeDatabase>
 #include <QProcess>
 #include <QShortcut>
 #include <QTreeView>
@@ -45,16 +45,9 @@ public:
     {
         if (info.isDir())
             return QIcon(FileSystemManager::mimeIconPath("folder"));
-        QMimeDatabase db;
-        auto t = db.mimeTypeForFile(info);
-        if (t.isValid()) {
-            auto resName = FileSystemManager::mimeIconPath(t.iconName());
-            if (QFile(resName).exists())
-                return QIcon(resName);
-            resName = FileSystemManager::mimeIconPath(t.genericIconName());
-            if (QFile(resName).exists())
-                return QIcon(resName);
-        }
+        auto resName = FileClassifier::classify(info).iconPath;
+        if (!resName.isEmpty())
+            return QIcon(resName);
         return QFileIconProvider::icon(info);
     }
 };
@@ -17,29 +17,34 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include "appconfig.h"
+#include "documentmanager.h"
 #include "findinfilesdialog.h"
+#include "findinfilesengine.h"
+#include "findresultmodel.h"
+#include "idocumenteditor.h"
+#include "replaceinfiles.h"
+#include "replacepreviewdialog.h"
+#include "textmessagebrocker.h"
 #include "ui_findinfilesdialog.h"
 
-#include <QDirIterator>
 #include <QFileDialog>
 #include <QListView>
 #include <QMenu>
+#include <QRegularExpression>
 #include <QStandardItemModel>
 #include <QWidgetAction>
+
 #include <Qsci/qsciscintilla.h>
-#include <utility>
 
-struct FilePos {
-    int line{ 0 };
-    int column{ 0 };
-    QString path;
+#include <memory>
 
-    FilePos() = default;
-    FilePos(int l, int c, QString p) : line(l), column(c), path(std::move(p)) {}
+struct ReplaceState {
+    QHash<QString, QByteArray> editorContents;
+    int editorFiles{ 0 };
+    int editorReplacements{ 0 };
+    QStringList errors;
 };
 
-Q_DECLARE_METATYPE(FilePos)
-
 const QStringList STANDARD_FILTERS =
         { "*.*", "*.c", "*.cpp", "*.h", "*.hpp", "*.txt" };
 
@@ -53,15 +58,14 @@ FindInFilesDialog::FindInFilesDialog(QWidget *parent) :
         { ui->buttonSelectfilePattern, "application-menu" },
         { ui->buttonFind, "edit-find" },
         { ui->buttonStop, "dialog-cancel" },
+        { ui->buttonReplace, "edit-find-replace" },
     };
     for (const auto& e: buttonmap)
         e.b->setIcon(QIcon{AppConfig::resourceImage({ "actions", e.name })});
 
-    auto model = new QStandardItemModel(this);
+    auto model = new FindResultModel(this);
+    model->setFont(AppConfig::instance().loggerFont());
     ui->treeView->setModel(model);
-    auto protoItem = new QStandardItem();
-    protoItem->setFont(AppConfig::instance().loggerFont());
-    model->setItemPrototype(protoItem);
     ui->textToFind->addMenuActions(QHash<QString, QString>{
                                       { tr("Regular Expression"), "regex" },
                                       { tr("Case Sensitive"), "case" },
@@ -98,82 +102,136 @@ FindInFilesDialog::FindInFilesDialog(QWidget *parent) :
     ui->buttonSelectfilePattern->setMenu(filterMenu);
     ui->buttonSelectfilePattern->setPopupMode(QToolButton::InstantPopup);
 
-    connect(ui->treeView, &QTreeView::activated,
-            [this, model](const QModelIndex& index) {
-        auto item = model->itemFromIndex(index);
-        if (item) {
-            auto pos = item->data().value<FilePos>();
-            emit queryToOpen(pos.path, pos.line, pos.column);
+    connect(ui->treeView, &QTreeView::activated, [this](const QModelIndex& index) {
+        if (index.parent().isValid()) {
+            emit queryToOpen(index.data(FindResultModel::PathRole).toString(),
+                             index.data(FindResultModel::LineRole).toInt(),
+                             index.data(FindResultModel::ColumnRole).toInt());
             accept();
         }
     });
 
-    auto doc = new QsciScintilla(this);
-    doc->hide();
-    connect(ui->buttonFind, &QToolButton::clicked, [this, model, doc]() {
-        setProperty("onProcessLoop", true);
+    engine = new FindInFilesEngine(this);
+    auto lastQuery = std::make_shared<FindInFilesEngine::Query>();
+    connect(ui->buttonFind, &QToolButton::clicked, [this, model, lastQuery]() {
         model->clear();
+        ui->buttonReplace->setDisabled(true);
+        model->setRootPath(ui->textDirectory->text());
         ui->buttonStop->setEnabled(true);
         ui->buttonFind->setDisabled(true);
+        ui->labelStatus->setText(tr("Scanning files..."));
+        ui->labelFilename->clear();
         QStringList filters = ui->textFilePattern->text().split(",")
                 .replaceInStrings(QRegularExpression(R"(^\s+)"), QString())
                 .replaceInStrings(QRegularExpression(R"(\s+$)"), QString());
-        QString textToFind = ui->textToFind->text();
-        bool isRegex = ui->textToFind->isPropertyChecked("regex");
-        bool isCS = ui->textToFind->isPropertyChecked("case");
-        bool isWWord = ui->textToFind->isPropertyChecked("wword");
-        QDirIterator it(ui->textDirectory->text(), filters,
-                        QDir::NoFilter, QDirIterator::Subdirectories);
-        while (it.hasNext() && property("onProcessLoop").toBool()) {
-            QCoreApplication::processEvents();
-            if (!property("onProcessLoop").toBool())
-                break;
-            ui->labelStatus->setText(tr("Scanning file:"));
-            ui->labelFilename->setText(QFontMetrics(ui->labelStatus->font())
-                                       .elidedText(it.next(), Qt::ElideLeft, ui->labelStatus->width()));
-            auto info = it.fileInfo();
-            if (!info.isFile())
-                continue;
-            QFile file(info.absoluteFilePath());
-            if (!file.open(QFile::ReadOnly))
-                continue;
-            if (!doc->read(&file))
-                continue;
-            if (!doc->findFirst(textToFind, isRegex, isCS, isWWord, false, true, -1, -1, false, false))
-                continue;
-            auto fileItem = model->itemPrototype()->clone();
-            fileItem->setText(info.absoluteFilePath().remove(ui->textDirectory->text() + QDir::separator()));
-            model->appendRow(fileItem);
-            do {
-                int line;
-                int column;
-                doc->getCursorPosition(&line, &column);
-                auto textInFile = doc->text(line);
-                auto posItem = model->itemPrototype()->clone();
-                constexpr auto JUSTIFY = 8;
-                posItem->setText(tr("Line %1 Char %2: %3").arg(
-                    QString("%1").arg(line).leftJustified(JUSTIFY, ' '),
-                    QString("%1").arg(column).leftJustified(JUSTIFY, ' '),
-                    textInFile));
-                posItem->setData(QVariant::fromValue(FilePos{ line, column, info.absoluteFilePath() }));
-                posItem->setData(Qt::AlignBaseline, Qt::TextAlignmentRole);
-                fileItem->appendRow(posItem);
-                QCoreApplication::processEvents();
-            } while (doc->findNext() && property("onProcessLoop").toBool());
-        }
+        FindInFilesEngine::Query query;
+        query.text = ui->textToFind->text();
+        query.isRegex = ui->textToFind->isPropertyChecked("regex");
+        query.caseSensitive = ui->textToFind->isPropertyChecked("case");
+        query.wholeWords = ui->textToFind->isPropertyChecked("wword");
+        *lastQuery = query;
+        engine->start(ui->textDirectory->text(), filters, query);
+    });
+    connect(engine, &FindInFilesEngine::hitsFound, [this, model](const FindInFilesEngine::HitList& hits) {
+        // Open groups only while the list is short, a common word would otherwise
+        // have the view lay out every hit
+        constexpr auto AUTO_EXPAND_HITS = 500;
+        auto first = model->fileCount();
+        model->appendHits(hits);
+        if (model->hitCount() <= AUTO_EXPAND_HITS)
+            for (int row = first; row < model->fileCount(); row++)
+                ui->treeView->expand(model->index(row, 0));
+    });
+    connect(engine, &FindInFilesEngine::progress, [this](int scanned, int total) {
+        ui->labelFilename->setText(tr("%1 of %2 files").arg(scanned).arg(total));
+    });
+    connect(engine, &FindInFilesEngine::error, [this](const QString& message) {
+        ui->labelFilename->setText(message);
+    });
+    connect(engine, &FindInFilesEngine::finished, [this](int files, int hits, bool canceled) {
         ui->buttonStop->setDisabled(true);
         ui->buttonFind->setEnabled(true);
-        ui->treeView->expandAll();
-        ui->labelStatus->setText(tr("Done"));
-        ui->labelFilename->clear();
-        setProperty("onProcessLoop", false);
+        ui->buttonReplace->setEnabled(!canceled && hits > 0);
+        ui->labelStatus->setText(canceled? tr("Stopped") : tr("Done"));
+        if (files > 0)
+            ui->labelFilename->setText(tr("%1 matches in %2 files").arg(hits).arg(files));
     });
-    connect(this, &QDialog::finished, [this]() {
-        setProperty("onProcessLoop", false);
+    connect(this, &QDialog::finished, engine, &FindInFilesEngine::cancel);
+
+    replacer = new ReplaceInFiles(this);
+    auto replaceState = std::make_shared<ReplaceState>();
+    connect(ui->buttonReplace, &QToolButton::clicked, [this, model, lastQuery, replaceState]() {
+        *replaceState = ReplaceState();
+        ReplaceInFiles::SourceList sources;
+        for (int row = 0; row < model->fileCount(); row++) {
+            auto path = model->index(row, 0).data(FindResultModel::PathRole).toString();
+            auto editor = documentManager? documentManager->documentEditor(path) : nullptr;
+            auto sci = editor? qobject_cast<QsciScintilla*>(editor->widget()) : nullptr;
+            if (sci) {
+                // Open documents are replaced in the buffer, unsaved changes included
+                auto length = int(sci->SendScintilla(QsciScintillaBase::SCI_GETLENGTH));
+                auto buffer = static_cast<const char*>(sci->SendScintillaPtrResult(QsciScintillaBase::SCI_GETCHARACTERPOINTER));
+                QByteArray content(buffer, length);
+                replaceState->editorContents.insert(path, content);
+                sources.append(ReplaceInFiles::Source{ path, content, true });
+            } else {
+                sources.append(ReplaceInFiles::Source{ path, QByteArray(), false });
+            }
+        }
+        ui->buttonReplace->setDisabled(true);
+        ui->buttonFind->setDisabled(true);
+        ui->labelStatus->setText(tr("Computing replacements..."));
+        replacer->compute(sources, *lastQuery, ui->textToReplace->text());
     });
-    connect(ui->buttonStop, &QToolButton::clicked, [this]() {
-        setProperty("onProcessLoop", false);
+    connect(replacer, &ReplaceInFiles::progress, [this](int done, int total) {
+        ui->labelFilename->setText(tr("%1 of %2 files").arg(done).arg(total));
     });
+    connect(replacer, &ReplaceInFiles::editsReady, [this, replaceState](const ReplaceInFiles::FileEditsList& files) {
+        ui->buttonFind->setEnabled(true);
+        ui->labelFilename->clear();
+        if (files.isEmpty()) {
+            ui->buttonReplace->setEnabled(true);
+            ui->labelStatus->setText(tr("Nothing to replace"));
+            return;
+        }
+        ReplacePreviewDialog preview(files, replaceState->editorContents, ui->textDirectory->text(), this);
+        if (preview.exec() != QDialog::Accepted) {
+            ui->buttonReplace->setEnabled(true);
+            ui->labelStatus->setText(tr("Ready"));
+            return;
+        }
+        auto selected = preview.selectedFiles();
+        for (const auto& file: selected) {
+            if (!file.inEditor)
+                continue;
+            auto editor = documentManager? documentManager->documentEditor(file.path) : nullptr;
+            auto sci = editor? qobject_cast<QsciScintilla*>(editor->widget()) : nullptr;
+            if (sci && ReplaceInFiles::applyToEditor(sci, file)) {
+                replaceState->editorFiles++;
+                replaceState->editorReplacements += file.edits.size();
+            } else {
+                replaceState->errors.append(tr("%1: modified since the preview").arg(file.path));
+            }
+        }
+        ui->buttonFind->setDisabled(true);
+        ui->labelStatus->setText(tr("Replacing..."));
+        replacer->apply(selected);
+    });
+    connect(replacer, &ReplaceInFiles::applied, [this, model, replaceState](int files, int replacements, const QStringList& errors) {
+        auto allErrors = replaceState->errors + errors;
+        for (const auto& e: allErrors)
+            TextMessageBrocker::instance().publish(TextMessages::STDERR_LOG, e);
+        // Offsets of the listed hits are stale now
+        model->clear();
+        ui->buttonFind->setEnabled(true);
+        ui->labelStatus->setText(allErrors.isEmpty()? tr("Done") : tr("Done with %1 errors").arg(allErrors.size()));
+        ui->labelFilename->setText(tr("%1 replacements in %2 files")
+                                   .arg(replacements + replaceState->editorReplacements)
+                                   .arg(files + replaceState->editorFiles));
+    });
+    // Writes run to completion once started, the log reports them even with the dialog closed
+    connect(this, &QDialog::finished, replacer, &ReplaceInFiles::cancelCompute);
+    connect(ui->buttonStop, &QToolButton::clicked, engine, &FindInFilesEngine::cancel);
 
     connect(ui->buttonChoseDirectory, &QToolButton::clicked, [this]() {
         QString path = QFileDialog::getExistingDirectory(this,
@@ -193,6 +251,16 @@ QString FindInFilesDialog::findPath() const
     return ui->textDirectory->text();
 }
 
+void FindInFilesDialog::setDocumentManager(DocumentManager *manager)
+{
+    documentManager = manager;
+}
+
+void FindInFilesDialog::setTextIndex(TrigramIndex *index)
+{
+    engine->setIndex(index);
+}
+
 void FindInFilesDialog::setFindPath(const QString &path)
 {
     ui->textDirectory->setText(path);
@@ -200,5 +268,5 @@ void FindInFilesDialog::setFindPath(const QString &path)
 
 void FindInFilesDialog::closeEvent(QCloseEvent *)
 {
-    setProperty("onProcessLoop", false);
+    engine->cancel();
 }
@@ -27,6 +27,10 @@
 
 class ProjectView;
 class DocumentArea;
+class DocumentManager;
+class FindInFilesEngine;
+class ReplaceInFiles;
+class TrigramIndex;
 
 namespace Ui {
 class FindInFilesDialog;
@@ -44,6 +48,8 @@ public:
     virtual ~FindInFilesDialog() override;
 
     QString findPath() const;
+    void setDocumentManager(DocumentManager *manager);
+    void setTextIndex(TrigramIndex *index);
 
 public slots:
     void setFindPath(const QString& path);
@@ -55,6 +61,9 @@ protected:
     virtual void closeEvent(QCloseEvent *) override;
 private:
     std::unique_ptr<Ui::FindInFilesDialog> ui;
+    FindInFilesEngine *engine{ nullptr };
+    ReplaceInFiles *replacer{ nullptr };
+    DocumentManager *documentManager{ nullptr };
 };
 
 #endif // FINDINFILESDIALOG_H
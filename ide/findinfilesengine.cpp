@@ -0,0 +1,388 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "findinfilesengine.h"
+#include "trigramindex.h"
+
+#include <QDirIterator>
+#include <QFile>
+#include <QFutureWatcher>
+#include <QPointer>
+#include <QRegularExpression>
+#include <QTimer>
+#include <QtConcurrent>
+
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <limits>
+
+static constexpr int BINARY_PROBE_SIZE = 8000;
+static constexpr int FLUSH_INTERVAL = 100;
+
+static inline bool isWordByte(uchar c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+}
+
+static bool isAscii(const QString& s)
+{
+    for (auto c: s)
+        if (c.unicode() >= 0x80)
+            return false;
+    return true;
+}
+
+class FindInFilesEngine::Matcher
+{
+public:
+    // Literal search straight on the mapped bytes, Boyer-Moore-Horspool over a
+    // folding table so case insensitive ASCII costs the same as exact match
+    QByteArray needle;
+    std::array<uchar, 256> fold;
+    std::array<int, 256> shift;
+    bool wholeWords{ false };
+    // Anything else goes through PCRE (JIT when available) on the decoded text
+    QRegularExpression regex;
+    bool useRegex{ false };
+
+    template<typename F>
+    bool findLiteral(const uchar *s, int n, const std::atomic_bool *canceled, F onMatch) const {
+        const int m = needle.size();
+        const auto p = reinterpret_cast<const uchar*>(needle.constData());
+        int i = 0;
+        int checked = 0;
+        while (i <= n - m) {
+            int j = m - 1;
+            while (j >= 0 && fold[s[i + j]] == p[j])
+                j--;
+            if (j < 0 && (!wholeWords || ((i == 0 || !isWordByte(s[i - 1])) &&
+                                          (i + m == n || !isWordByte(s[i + m]))))) {
+                onMatch(i, m);
+                i += m;
+            } else {
+                i += shift[fold[s[i + m - 1]]];
+            }
+            // Cheap enough to not poll on every step, but keeps huge files interruptible
+            if (canceled && i - checked > (1 << 20)) {
+                if (*canceled)
+                    return false;
+                checked = i;
+            }
+        }
+        return true;
+    }
+
+    // Calls onMatch(offset, length, match) with byte offsets, match is null for literals
+    template<typename F>
+    void forEachMatch(const char *raw, int n, const std::atomic_bool *canceled, F onMatch) const {
+        if (!useRegex) {
+            findLiteral(reinterpret_cast<const uchar*>(raw), n, canceled, [&onMatch](int offset, int length) {
+                onMatch(offset, length, static_cast<const QRegularExpressionMatch*>(nullptr));
+            });
+            return;
+        }
+        auto text = QString::fromUtf8(raw, n);
+        auto it = regex.globalMatch(text);
+        // Match offsets are in UTF-16 units, walk the bytes alongside to report byte offsets
+        int charPos = 0;
+        int bytePos = 0;
+        auto toByte = [&](int pos) {
+            if (pos > charPos) {
+                bytePos += QStringRef(&text, charPos, pos - charPos).toUtf8().size();
+                charPos = pos;
+            }
+            return bytePos;
+        };
+        while (it.hasNext()) {
+            if (canceled && *canceled)
+                break;
+            auto m = it.next();
+            if (m.capturedLength() == 0)
+                continue;
+            auto start = toByte(m.capturedStart());
+            onMatch(start, m.capturedRef().toUtf8().size(), &m);
+        }
+    }
+};
+
+// Replacement text with \N or $N standing for regex groups
+static QByteArray expandReplacement(const QString& replacement, const QRegularExpressionMatch *m)
+{
+    if (!m)
+        return replacement.toUtf8();
+    QString out;
+    for (int i = 0; i < replacement.size(); i++) {
+        auto c = replacement.at(i);
+        if ((c == '\\' || c == '$') && i + 1 < replacement.size()) {
+            auto next = replacement.at(i + 1);
+            if (next.isDigit()) {
+                out.append(m->captured(next.digitValue()));
+                i++;
+                continue;
+            }
+            if (c == '\\' && next == '\\') {
+                out.append(c);
+                i++;
+                continue;
+            }
+        }
+        out.append(c);
+    }
+    return out.toUtf8();
+}
+
+class FindInFilesEngine::Priv_t
+{
+public:
+    QPointer<QFutureWatcher<QStringList>> listWatcher;
+    QPointer<QFutureWatcher<HitList>> searchWatcher;
+    QPointer<TrigramIndex> index;
+    std::shared_ptr<std::atomic_bool> canceled;
+    QTimer *flushTimer{ nullptr };
+    HitList pending;
+    int fileCount{ 0 };
+    int hitCount{ 0 };
+
+    bool abort() {
+        if (canceled)
+            *canceled = true;
+        bool running = listWatcher || searchWatcher;
+        listWatcher.clear();
+        if (searchWatcher)
+            searchWatcher->cancel();
+        searchWatcher.clear();
+        flushTimer->stop();
+        pending.clear();
+        return running;
+    }
+};
+
+struct FileSearcher {
+    using result_type = FindInFilesEngine::HitList;
+
+    FindInFilesEngine::MatcherPtr matcher;
+    std::shared_ptr<std::atomic_bool> canceled;
+
+    FindInFilesEngine::HitList operator()(const QString& path) const {
+        return FindInFilesEngine::searchFile(path, matcher, canceled.get());
+    }
+};
+
+FindInFilesEngine::FindInFilesEngine(QObject *parent) :
+    QObject(parent),
+    priv(std::make_unique<Priv_t>())
+{
+    qRegisterMetaType<FindInFilesEngine::HitList>();
+    priv->flushTimer = new QTimer(this);
+    priv->flushTimer->setInterval(FLUSH_INTERVAL);
+    connect(priv->flushTimer, &QTimer::timeout, this, &FindInFilesEngine::flushHits);
+}
+
+FindInFilesEngine::~FindInFilesEngine()
+{
+    priv->abort();
+}
+
+bool FindInFilesEngine::isRunning() const
+{
+    return priv->listWatcher || priv->searchWatcher;
+}
+
+void FindInFilesEngine::setIndex(TrigramIndex *index)
+{
+    priv->index = index;
+}
+
+FindInFilesEngine::MatcherPtr FindInFilesEngine::compile(const FindInFilesEngine::Query &query, QString *errorMessage)
+{
+    if (query.text.isEmpty())
+        return nullptr;
+    auto matcher = std::make_shared<Matcher>();
+    matcher->wholeWords = query.wholeWords;
+    if (!query.isRegex && (query.caseSensitive || isAscii(query.text))) {
+        for (int c = 0; c < 256; c++)
+            matcher->fold[size_t(c)] = uchar(query.caseSensitive? c : std::tolower(c));
+        matcher->needle = query.text.toUtf8();
+        for (auto& c: matcher->needle)
+            c = char(matcher->fold[uchar(c)]);
+        const int m = matcher->needle.size();
+        matcher->shift.fill(m);
+        for (int i = 0; i < m - 1; i++)
+            matcher->shift[uchar(matcher->needle.at(i))] = m - 1 - i;
+        return matcher;
+    }
+    auto pattern = query.isRegex? query.text : QRegularExpression::escape(query.text);
+    if (query.wholeWords)
+        pattern = QString(R"(\b(?:%1)\b)").arg(pattern);
+    QRegularExpression::PatternOptions options = QRegularExpression::MultilineOption;
+    if (!query.caseSensitive)
+        options |= QRegularExpression::CaseInsensitiveOption;
+    matcher->regex = QRegularExpression(pattern, options);
+    if (!matcher->regex.isValid()) {
+        if (errorMessage)
+            *errorMessage = matcher->regex.errorString();
+        return nullptr;
+    }
+    matcher->regex.optimize();
+    matcher->useRegex = true;
+    return matcher;
+}
+
+FindInFilesEngine::HitList FindInFilesEngine::searchFile(const QString &path, const MatcherPtr &matcher,
+                                                         const std::atomic_bool *canceled)
+{
+    HitList hits;
+    QFile f(path);
+    if (!matcher || !f.open(QFile::ReadOnly) || f.size() == 0 || f.size() > std::numeric_limits<int>::max())
+        return hits;
+    const int n = int(f.size());
+    QByteArray buffer;
+    auto data = reinterpret_cast<const uchar*>(f.map(0, n));
+    if (!data) {
+        buffer = f.readAll();
+        data = reinterpret_cast<const uchar*>(buffer.constData());
+    }
+    if (std::memchr(data, 0, size_t(qMin(n, BINARY_PROBE_SIZE))))
+        return hits;
+    const auto raw = reinterpret_cast<const char*>(data);
+
+    // Lines are counted forward only, hits arrive in order
+    int line = 1;
+    int lineStart = 0;
+    int counted = 0;
+    auto lineOf = [&](int offset) {
+        while (counted < offset) {
+            auto nl = static_cast<const char*>(std::memchr(raw + counted, '\n', size_t(offset - counted)));
+            if (!nl) {
+                counted = offset;
+                break;
+            }
+            line++;
+            counted = int(nl - raw) + 1;
+            lineStart = counted;
+        }
+    };
+    auto addHit = [&](int offset, int length) {
+        lineOf(offset);
+        hits.append(Hit{ path, line, offset - lineStart, length, lineStart });
+    };
+
+    matcher->forEachMatch(raw, n, canceled, [&addHit](int offset, int length, const QRegularExpressionMatch *) {
+        addHit(offset, length);
+    });
+    return hits;
+}
+
+FindInFilesEngine::EditList FindInFilesEngine::replacementsIn(const QByteArray &text, const MatcherPtr &matcher,
+                                                              const QString &replacement)
+{
+    EditList edits;
+    if (!matcher || text.isEmpty() || std::memchr(text.constData(), 0, size_t(qMin(text.size(), BINARY_PROBE_SIZE))))
+        return edits;
+    matcher->forEachMatch(text.constData(), text.size(), nullptr,
+                          [&edits, &replacement](int offset, int length, const QRegularExpressionMatch *m) {
+        edits.append(Edit{ offset, length, expandReplacement(replacement, m) });
+    });
+    return edits;
+}
+
+void FindInFilesEngine::start(const QString &directory, const QStringList &filters, const FindInFilesEngine::Query &query)
+{
+    priv->abort();
+    QString errorMessage;
+    auto matcher = compile(query, &errorMessage);
+    if (!matcher) {
+        if (!errorMessage.isEmpty())
+            emit error(errorMessage);
+        emit finished(0, 0, false);
+        return;
+    }
+    priv->canceled = std::make_shared<std::atomic_bool>(false);
+    priv->fileCount = 0;
+    priv->hitCount = 0;
+    priv->pending.clear();
+
+    auto canceled = priv->canceled;
+    auto listWatcher = new QFutureWatcher<QStringList>(this);
+    priv->listWatcher = listWatcher;
+    connect(listWatcher, &QFutureWatcher<QStringList>::finished, [this, listWatcher, matcher, canceled]() {
+        listWatcher->deleteLater();
+        if (priv->listWatcher != listWatcher)
+            return;
+        priv->listWatcher.clear();
+        auto files = listWatcher->result();
+        priv->fileCount = files.size();
+        auto watcher = new QFutureWatcher<HitList>(this);
+        priv->searchWatcher = watcher;
+        connect(watcher, &QFutureWatcher<HitList>::resultsReadyAt, [this, watcher](int begin, int end) {
+            if (priv->searchWatcher != watcher)
+                return;
+            for (int i = begin; i < end; i++) {
+                const auto& hits = watcher->resultAt(i);
+                priv->hitCount += hits.size();
+                priv->pending += hits;
+            }
+        });
+        connect(watcher, &QFutureWatcher<HitList>::progressValueChanged, [this, watcher](int value) {
+            if (priv->searchWatcher == watcher)
+                emit progress(value, priv->fileCount);
+        });
+        connect(watcher, &QFutureWatcher<HitList>::finished, [this, watcher]() {
+            watcher->deleteLater();
+            if (priv->searchWatcher != watcher)
+                return;
+            priv->searchWatcher.clear();
+            priv->flushTimer->stop();
+            flushHits();
+            emit finished(priv->fileCount, priv->hitCount, false);
+        });
+        priv->flushTimer->start();
+        watcher->setFuture(QtConcurrent::mapped(files, FileSearcher{ matcher, canceled }));
+    });
+    auto lookup = priv->index? priv->index->lookup() : TrigramIndex::Lookup();
+    listWatcher->setFuture(QtConcurrent::run([directory, filters, query, canceled, lookup]() mutable {
+        // Files the index rules out are never opened, stale or unknown ones still are
+        bool narrowed = lookup.narrow(query.text, query.isRegex, query.caseSensitive);
+        QStringList files;
+        QDirIterator it(directory, filters, QDir::Files | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+        while (it.hasNext() && !*canceled) {
+            auto path = it.next();
+            if (!narrowed || lookup.mayMatch(it.fileInfo()))
+                files.append(path);
+        }
+        return files;
+    }));
+    if (priv->index)
+        priv->index->refresh();
+}
+
+void FindInFilesEngine::cancel()
+{
+    if (priv->abort())
+        emit finished(priv->fileCount, priv->hitCount, true);
+}
+
+void FindInFilesEngine::flushHits()
+{
+    if (!priv->pending.isEmpty()) {
+        HitList batch;
+        batch.swap(priv->pending);
+        emit hitsFound(batch);
+    }
+}
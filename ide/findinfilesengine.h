@@ -0,0 +1,89 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef FINDINFILESENGINE_H
+#define FINDINFILESENGINE_H
+
+#include "textedit.h"
+
+#include <QObject>
+#include <QStringList>
+#include <QVector>
+
+#include <atomic>
+#include <memory>
+
+class TrigramIndex;
+
+class FindInFilesEngine : public QObject
+{
+    Q_OBJECT
+public:
+    struct Query {
+        QString text;
+        bool isRegex{ false };
+        bool caseSensitive{ false };
+        bool wholeWords{ false };
+    };
+
+    struct Hit {
+        QString path;
+        int line;   // 1 based
+        int column; // bytes from the line start, as QScintilla counts
+        int length;
+        int lineStart; // byte offset of the line in the file
+    };
+    using HitList = QVector<Hit>;
+
+    using Edit = TextEdit;
+    using EditList = TextEditList;
+
+    class Matcher;
+    using MatcherPtr = std::shared_ptr<const Matcher>;
+
+    explicit FindInFilesEngine(QObject *parent = nullptr);
+    virtual ~FindInFilesEngine() override;
+
+    bool isRunning() const;
+    void setIndex(TrigramIndex *index);
+
+    static MatcherPtr compile(const Query& query, QString *errorMessage = nullptr);
+    static HitList searchFile(const QString& path, const MatcherPtr& matcher,
+                              const std::atomic_bool *canceled = nullptr);
+    static EditList replacementsIn(const QByteArray& text, const MatcherPtr& matcher, const QString& replacement);
+
+signals:
+    void hitsFound(const FindInFilesEngine::HitList& hits);
+    void progress(int scanned, int total);
+    void finished(int files, int hits, bool canceled);
+    void error(const QString& message);
+
+public slots:
+    void start(const QString& directory, const QStringList& filters, const FindInFilesEngine::Query& query);
+    void cancel();
+
+private:
+    void flushHits();
+
+    class Priv_t;
+    std::unique_ptr<Priv_t> priv;
+};
+
+Q_DECLARE_METATYPE(FindInFilesEngine::HitList)
+
+#endif // FINDINFILESENGINE_H
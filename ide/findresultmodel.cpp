@@ -0,0 +1,239 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "findresultmodel.h"
+
+#include <QCache>
+#include <QDir>
+#include <QFile>
+
+static constexpr int MAX_LINE_TEXT = 1024;
+static constexpr int LINE_CACHE_SIZE = 2000;
+static constexpr int JUSTIFY = 8;
+
+struct CompactHit {
+    int line;
+    int column;
+    int length;
+    int lineStart;
+};
+
+struct FileHits {
+    QString path;
+    QVector<CompactHit> hits;
+};
+
+static QString readLineFrom(QFile& f, int lineStart)
+{
+    if (!f.seek(lineStart))
+        return QString();
+    auto bytes = f.read(MAX_LINE_TEXT);
+    auto end = bytes.indexOf('\n');
+    if (end != -1)
+        bytes.truncate(end);
+    if (bytes.endsWith('\r'))
+        bytes.chop(1);
+    return QString::fromUtf8(bytes);
+}
+
+class FindResultModel::Priv_t
+{
+public:
+    QString rootPath;
+    QFont font;
+    QVector<FileHits> files;
+    QHash<QString, int> fileRows;
+    int hitCount{ 0 };
+    QCache<QPair<int, int>, QString> lines{ LINE_CACHE_SIZE };
+    // Visible rows are mostly neighbours in the same file
+    QFile current;
+
+    QString lineOf(int fileRow, const CompactHit& hit) {
+        auto key = qMakePair(fileRow, hit.lineStart);
+        if (auto cached = lines.object(key))
+            return *cached;
+        const auto& path = files.at(fileRow).path;
+        if (current.fileName() != path || !current.isOpen()) {
+            current.close();
+            current.setFileName(path);
+            if (!current.open(QFile::ReadOnly))
+                return QString();
+        }
+        auto text = readLineFrom(current, hit.lineStart);
+        lines.insert(key, new QString(text));
+        return text;
+    }
+};
+
+FindResultModel::FindResultModel(QObject *parent) :
+    QAbstractItemModel(parent),
+    priv(std::make_unique<Priv_t>())
+{
+}
+
+FindResultModel::~FindResultModel()
+{
+}
+
+void FindResultModel::setRootPath(const QString &path)
+{
+    priv->rootPath = path;
+}
+
+void FindResultModel::setFont(const QFont &font)
+{
+    priv->font = font;
+}
+
+void FindResultModel::appendHits(const FindInFilesEngine::HitList &hits)
+{
+    // Batches come ordered by file, new files are inserted with a single call
+    QVector<FileHits> added;
+    for (int i = 0; i < hits.size();) {
+        const auto& path = hits.at(i).path;
+        QVector<CompactHit> list;
+        for (; i < hits.size() && hits.at(i).path == path; i++) {
+            const auto& h = hits.at(i);
+            list.append(CompactHit{ h.line, h.column, h.length, h.lineStart });
+        }
+        priv->hitCount += list.size();
+        auto row = priv->fileRows.value(path, -1);
+        if (row == -1) {
+            if (!added.isEmpty() && added.last().path == path)
+                added.last().hits += list;
+            else
+                added.append(FileHits{ path, list });
+            continue;
+        }
+        auto parent = index(row, 0);
+        auto& existing = priv->files[row].hits;
+        beginInsertRows(parent, existing.size(), existing.size() + list.size() - 1);
+        existing += list;
+        endInsertRows();
+        emit dataChanged(parent, parent);
+    }
+    if (added.isEmpty())
+        return;
+    beginInsertRows(QModelIndex(), priv->files.size(), priv->files.size() + added.size() - 1);
+    for (const auto& file: added) {
+        priv->fileRows.insert(file.path, priv->files.size());
+        priv->files.append(file);
+    }
+    endInsertRows();
+}
+
+void FindResultModel::clear()
+{
+    beginResetModel();
+    priv->files.clear();
+    priv->fileRows.clear();
+    priv->hitCount = 0;
+    priv->lines.clear();
+    priv->current.close();
+    endResetModel();
+}
+
+int FindResultModel::fileCount() const
+{
+    return priv->files.size();
+}
+
+int FindResultModel::hitCount() const
+{
+    return priv->hitCount;
+}
+
+QModelIndex FindResultModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (!hasIndex(row, column, parent))
+        return QModelIndex();
+    // Internal id is 0 for files and the file row plus one for hits
+    return createIndex(row, column, parent.isValid()? quintptr(parent.row() + 1) : quintptr(0));
+}
+
+QModelIndex FindResultModel::parent(const QModelIndex &child) const
+{
+    if (!child.isValid() || child.internalId() == 0)
+        return QModelIndex();
+    return createIndex(int(child.internalId() - 1), 0, quintptr(0));
+}
+
+int FindResultModel::rowCount(const QModelIndex &parent) const
+{
+    if (!parent.isValid())
+        return priv->files.size();
+    if (parent.internalId() == 0 && parent.column() == 0)
+        return priv->files.at(parent.row()).hits.size();
+    return 0;
+}
+
+int FindResultModel::columnCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent)
+    return 1;
+}
+
+QVariant FindResultModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+        return QVariant();
+    if (role == Qt::FontRole)
+        return priv->font;
+    if (index.internalId() == 0) {
+        const auto& file = priv->files.at(index.row());
+        switch (role) {
+        case Qt::DisplayRole: {
+            auto name = priv->rootPath.isEmpty()? file.path : QDir(priv->rootPath).relativeFilePath(file.path);
+            return tr("%1 (%2)").arg(name).arg(file.hits.size());
+        }
+        case PathRole:
+            return file.path;
+        case HitCountRole:
+            return file.hits.size();
+        }
+        return QVariant();
+    }
+    auto fileRow = int(index.internalId() - 1);
+    const auto& hit = priv->files.at(fileRow).hits.at(index.row());
+    switch (role) {
+    case Qt::DisplayRole:
+        return tr("Line %1 Char %2: %3").arg(
+            QString("%1").arg(hit.line).leftJustified(JUSTIFY, ' '),
+            QString("%1").arg(hit.column).leftJustified(JUSTIFY, ' '),
+            priv->lineOf(fileRow, hit));
+    case Qt::TextAlignmentRole:
+        return int(Qt::AlignBaseline);
+    case PathRole:
+        return priv->files.at(fileRow).path;
+    case LineRole:
+        return hit.line;
+    case ColumnRole:
+        return hit.column;
+    case LengthRole:
+        return hit.length;
+    }
+    return QVariant();
+}
+
+QString FindResultModel::readLine(const QString &path, int lineStart)
+{
+    QFile f(path);
+    if (!f.open(QFile::ReadOnly))
+        return QString();
+    return readLineFrom(f, lineStart);
+}
@@ -0,0 +1,67 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef FINDRESULTMODEL_H
+#define FINDRESULTMODEL_H
+
+#include "findinfilesengine.h"
+
+#include <QAbstractItemModel>
+#include <QFont>
+
+#include <memory>
+
+// Files at the top level with their hits as children. A hit is kept as a few
+// integers and its line is read back from disk only when a view asks for it
+class FindResultModel : public QAbstractItemModel
+{
+    Q_OBJECT
+public:
+    enum Role {
+        PathRole = Qt::UserRole + 1,
+        LineRole,
+        ColumnRole,
+        LengthRole,
+        HitCountRole,
+    };
+
+    explicit FindResultModel(QObject *parent = nullptr);
+    virtual ~FindResultModel() override;
+
+    void setRootPath(const QString& path);
+    void setFont(const QFont& font);
+    void appendHits(const FindInFilesEngine::HitList& hits);
+    void clear();
+
+    int fileCount() const;
+    int hitCount() const;
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    static QString readLine(const QString& path, int lineStart);
+
+private:
+    class Priv_t;
+    std::unique_ptr<Priv_t> priv;
+};
+
+#endif // FINDRESULTMODEL_H
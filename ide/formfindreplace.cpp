@@ -19,6 +19,8 @@
 #include "formfindreplace.h"
 #include "Qsci/qsciscintilla.h"
 #include "appconfig.h"
+#include "findinfilesengine.h"
+#include "replaceinfiles.h"
 
 #include "ui_formfindreplace.h"
 
@@ -134,6 +136,14 @@ bool FormFindReplace::on_buttonFind_clicked()
 
 void FormFindReplace::on_buttonReplace_clicked()
 {
+    if (ui->textToReplace->isPropertyChecked("replaceAll")) {
+        auto found = replaceAll() > 0;
+        auto pal = ui->textToFind->palette();
+        pal.setBrush(QPalette::Base, found? palette().base() : QBrush(QColor(Qt::red).lighter()));
+        ui->textToFind->setPalette(pal);
+        setProperty("isFirst", true);
+        return;
+    }
     while (on_buttonFind_clicked()) {
         auto replaceText = ui->textToReplace->text();
         editor->replace(replaceText);
@@ -142,6 +152,39 @@ void FormFindReplace::on_buttonReplace_clicked()
     }
 }
 
+int FormFindReplace::replaceAll()
+{
+    FindInFilesEngine::Query query;
+    query.text = ui->textToFind->text();
+    query.isRegex = ui->textToFind->isPropertyChecked("regex");
+    query.caseSensitive = ui->textToFind->isPropertyChecked("case");
+    query.wholeWords = ui->textToFind->isPropertyChecked("wword");
+    auto matcher = FindInFilesEngine::compile(query);
+    if (!matcher)
+        return 0;
+    auto length = int(editor->SendScintilla(QsciScintillaBase::SCI_GETLENGTH));
+    int start = 0;
+    int end = length;
+    bool selonly = ui->textToFind->isPropertyChecked("selonly") && editor->hasSelectedText();
+    if (selonly) {
+        start = int(editor->SendScintilla(QsciScintillaBase::SCI_GETSELECTIONSTART));
+        end = int(editor->SendScintilla(QsciScintillaBase::SCI_GETSELECTIONEND));
+    }
+    // Matches come from the raw buffer in one pass instead of a findNext/replace round trip each
+    auto buffer = static_cast<const char*>(editor->SendScintillaPtrResult(QsciScintillaBase::SCI_GETCHARACTERPOINTER));
+    auto edits = FindInFilesEngine::replacementsIn(QByteArray::fromRawData(buffer + start, end - start),
+                                                   matcher, ui->textToReplace->text());
+    if (edits.isEmpty())
+        return 0;
+    int delta = 0;
+    for (const auto& e: edits)
+        delta += e.text.size() - e.length;
+    ReplaceInFiles::replaceTargets(editor, start, edits);
+    if (selonly)
+        editor->SendScintilla(QsciScintillaBase::SCI_SETSEL, static_cast<unsigned long>(start), static_cast<long>(end + delta));
+    return edits.size();
+}
+
 void FormFindReplace::on_textToFind_textChanged(const QString &text)
 {
     Q_UNUSED(text)
@@ -53,6 +53,8 @@ private slots:
     void on_textToFind_returnPressed();
 
 private:
+    int replaceAll();
+
     std::unique_ptr<Ui::FormFindReplace> ui;
     QsciScintilla *editor;
 };
@@ -57,23 +57,47 @@ public:
         QString toString() const;
     };
 
+    struct IncludeCost {
+        int files = 0; // transitive closure, the header itself included
+        qint64 bytes = 0;
+        int translationUnits = 0; // sources that end up including it
+    };
+
     using SymbolList = QList<Symbol>;
     using FileReferenceList = QList<FileReference>;
     using SymbolSet = QSet<ICodeModelProvider::Symbol>;
     using SymbolSetMap = QHash<QString, SymbolSet>;
+    using IncludeCostMap = QHash<QString, IncludeCost>;
 
     using FindReferenceCallback_t = std::function<void (const FileReferenceList& ref)>;
     using CompletionCallback_t = std::function<void (const QStringList& completionList)>;
     using SymbolRequestCallback_t = std::function<void (const SymbolSetMap& completionList)>;
     using FinishIndexProjectCallback_t = std::function<void ()>;
     using FinishIndexFileCallback_t = std::function<void ()>;
+    using AffectedFilesCallback_t = std::function<void (const QStringList& translationUnits)>;
+    using IncludeCostCallback_t = std::function<void (const IncludeCostMap& costs)>;
+    using MacroMap = QHash<QByteArray, QByteArray>;
+    using MacrosCallback_t = std::function<void (bool known, const MacroMap& macros)>;
 
     virtual void startIndexingProject(const QString& path, FinishIndexProjectCallback_t cb) = 0;
     virtual void startIndexingFile(const QString& path, FinishIndexFileCallback_t cb) = 0;
 
     virtual void referenceOf(const QString& entity, FindReferenceCallback_t cb) = 0;
-    virtual void completionAt(const FileReference& ref, const QString& unsaved, CompletionCallback_t cb) = 0;
+    // ref points to the start of the word under completion, prefix is the part already typed
+    // and revision changes each time the document is modified outside of that word
+    virtual void completionAt(const FileReference& ref, const QString& prefix, int revision,
+                              const QByteArray& unsaved, CompletionCallback_t cb) = 0;
     virtual void requestSymbolForFile(const QString& path, SymbolRequestCallback_t cb) = 0;
+    // Identifiers seen across the project starting with prefix, most frequent first
+    virtual void wordCompletions(const QString& prefix, int limit, CompletionCallback_t cb) = 0;
+
+    // Sources that must be rebuilt or rechecked when path changes
+    virtual void affectedTranslationUnits(const QString& path, AffectedFilesCallback_t cb) = 0;
+    // Cost of every header reachable from the project sources
+    virtual void includeCosts(IncludeCostCallback_t cb) = 0;
+    // Toolchain builtins plus the -D and -U of the command compiling path, known is
+    // false when no compile command covers it
+    virtual void macrosFor(const QString& path, MacrosCallback_t cb) = 0;
 };
 
 Q_DECLARE_METATYPE(ICodeModelProvider::FileReference)
@@ -69,7 +69,24 @@ SOURCES += \
     mapfileviewer.cpp \
     textmessagebrocker.cpp \
     regexhtmltranslator.cpp \
-    imageviewer.cpp
+    imageviewer.cpp \
+    compilecommanddatabase.cpp \
+    toolchainregistry.cpp \
+    usageindex.cpp \
+    includegraph.cpp \
+    semantickeywords.cpp \
+    findinfilesengine.cpp \
+    trigramindex.cpp \
+    findresultmodel.cpp \
+    replaceinfiles.cpp \
+    replacepreviewdialog.cpp \
+    textfileprofile.cpp \
+    linediff.cpp \
+    wordindex.cpp \
+    preprocessorregions.cpp \
+    codeformatter.cpp \
+    projectformatter.cpp \
+    fileclassifier.cpp
 
 HEADERS += \
     buttoneditoritemdelegate.h \
@@ -107,7 +124,25 @@ HEADERS += \
     mapfileviewer.h \
     textmessagebrocker.h \
     regexhtmltranslator.h \
-    imageviewer.h
+    imageviewer.h \
+    compilecommanddatabase.h \
+    toolchainregistry.h \
+    usageindex.h \
+    includegraph.h \
+    semantickeywords.h \
+    findinfilesengine.h \
+    trigramindex.h \
+    findresultmodel.h \
+    replaceinfiles.h \
+    replacepreviewdialog.h \
+    textfileprofile.h \
+    linediff.h \
+    wordindex.h \
+    preprocessorregions.h \
+    codeformatter.h \
+    projectformatter.h \
+    fileclassifier.h \
+    textedit.h
 
 FORMS += \
         mainwindow.ui \
@@ -119,7 +154,8 @@ FORMS += \
     findinfilesdialog.ui \
     templatemanager.ui \
     templateitemwidget.ui \
-    filereferencesdialog.ui
+    filereferencesdialog.ui \
+    replacepreviewdialog.ui
 
 CONFIG += mobility
 MOBILITY = 
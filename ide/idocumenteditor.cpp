@@ -17,9 +17,8 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include "idocumenteditor.h"
+#include "fileclassifier.h"
 
-#include <QFile>
-#include <QFileInfo>
 #include <QMimeDatabase>
 
 DocumentEditorFactory::DocumentEditorFactory()
@@ -36,27 +35,33 @@ DocumentEditorFactory *DocumentEditorFactory::instance()
 void DocumentEditorFactory::registerDocumentInterface(IDocumentEditorCreator *creator)
 {
     creators << creator;
+    resolved.clear();
 }
 
 IDocumentEditor *DocumentEditorFactory::create(const QString &path, QWidget *parent)
 {
-    QMimeDatabase db;
-    auto mime = db.mimeTypeForFile(path);
-    auto info = QFileInfo(path);
-    auto suffixes = QStringList(info.suffix()) << mime.suffixes();
-    if (info.size() == 0) {
-        // FIXME: Force the content type of empty files to plain-text
-        mime = db.mimeTypeForData(QByteArray{"\n"});
-    }
+    QFileInfo info(path);
+    auto type = FileClassifier::classify(info);
+    auto empty = info.size() == 0;
+    auto key = empty? type.key + "\nempty" : type.key;
+    auto it = resolved.constFind(key);
+    if (it == resolved.constEnd())
+        it = resolved.insert(key, creatorFor(type.suffixes, type.mime, empty));
+    return it.value()? it.value()->create(parent) : nullptr;
+}
 
+IDocumentEditorCreator *DocumentEditorFactory::creatorFor(const QStringList &suffixes, const QMimeType &mime, bool empty) const
+{
     // Try first from suffix
     for(auto c: creators)
         if (c->canHandleExtentions(suffixes))
-            return c->create(parent);
+            return c;
+    // FIXME: Force the content type of empty files to plain-text
+    auto contentType = empty? QMimeDatabase().mimeTypeForData(QByteArray{"\n"}) : mime;
     // Try second from mimetype
     for(auto c: creators)
-        if (c->canHandleMime(mime))
-            return c->create(parent);
+        if (c->canHandleMime(contentType))
+            return c;
     return nullptr;
 }
 
@@ -21,6 +21,7 @@
 
 #include "documentmanager.h"
 
+#include <QHash>
 #include <QObject>
 #include <QWidget>
 #include <QString>
@@ -36,6 +37,7 @@ class IDocumentEditor
 public:
     using ModifyObserver_t = std::function<void (IDocumentEditor *, bool)>;
     using CursorObserver_t = std::function<void (IDocumentEditor *, int line, int col)>;
+    using SaveCallback_t = std::function<void (bool ok)>;
 
     virtual ~IDocumentEditor();
 
@@ -43,7 +45,15 @@ public:
     virtual QWidget *widget() = 0;
     virtual bool load(const QString& path) = 0;
     virtual bool save(const QString& path) = 0;
+    // Editors able to write from a worker override this, done runs on the GUI thread
+    virtual void saveInBackground(const QString& path, SaveCallback_t done) {
+        auto ok = save(path);
+        if (done)
+            done(ok);
+    }
     virtual void reload() = 0;
+    // True while a background save of this document has not finished
+    virtual bool isSaving() const { return false; }
     virtual QString path() const { return widget()->windowFilePath(); }
     virtual void setPath(const QString& path) { widget()->setWindowFilePath(path); }
     virtual bool isReadonly() const = 0;
@@ -52,6 +62,13 @@ public:
     virtual void setModified(bool m) = 0;
     virtual QPoint cursor() const = 0;
     virtual void setCursor(const QPoint& pos) = 0;
+    // First line shown, 0 based, for editors that scroll by lines
+    virtual int scrollLine() const { return 0; }
+    virtual void setScrollLine(int line) { Q_UNUSED(line) }
+    // Rough bytes held by the editor, those reporting 0 are never evicted from the document pool
+    virtual qint64 memoryUsage() const { return 0; }
+    // Extra view on the same document for split panes, nullptr when the editor cannot share it
+    virtual QWidget *createSplitView(QWidget *parent) { Q_UNUSED(parent) return nullptr; }
 
     void setDocumentManager(DocumentManager *man) { this->man = man; }
     DocumentManager *documentManager() const { return this->man; }
@@ -104,7 +121,10 @@ class DocumentEditorFactory: public QObject
 
 private:
     DocumentEditorFactory();
+    IDocumentEditorCreator *creatorFor(const QStringList& suffixes, const QMimeType& mime, bool empty) const;
+
     QList<IDocumentEditorCreator*> creators;
+    QHash<QString, IDocumentEditorCreator*> resolved; // by FileClassifier key
 
 public:
     static DocumentEditorFactory* instance();
@@ -0,0 +1,203 @@
+/*
+ * This file is part of Embedded-IDE
+ *
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "includegraph.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegularExpression>
+
+static const QStringList TRANSLATION_UNIT_SUFFIXES = { "c", "cc", "cpp", "cxx", "c++", "C", "s", "S", "sx" };
+static const QStringList SEARCH_PATH_OPTIONS = { "-I", "-isystem", "-iquote", "-idirafter" };
+
+static const QRegularExpression INCLUDE_RE(R"(^[ \t]*#[ \t]*(?:include|include_next|import)[ \t]*([<"])([^>"\r\n]+)[>"])",
+                                           QRegularExpression::MultilineOption);
+
+class IncludeResolver
+{
+public:
+    QString resolve(const QString& name, const QString& includerDir, const QStringList& searchPaths) {
+        if (QDir::isAbsolutePath(name))
+            return QFileInfo::exists(name)? QDir::cleanPath(name) : QString();
+        if (!includerDir.isEmpty()) {
+            auto local = QDir(includerDir).absoluteFilePath(name);
+            if (QFileInfo::exists(local))
+                return QDir::cleanPath(local);
+        }
+        // Same search path list resolves the same name to the same file, skip the stat storm
+        auto& cache = cached[searchPaths.join('\n')];
+        auto it = cache.find(name);
+        if (it == cache.end()) {
+            QString found;
+            for (const auto& dir: searchPaths) {
+                auto candidate = QDir(dir).absoluteFilePath(name);
+                if (QFileInfo::exists(candidate)) {
+                    found = QDir::cleanPath(candidate);
+                    break;
+                }
+            }
+            it = cache.insert(name, found);
+        }
+        return it.value();
+    }
+
+private:
+    QHash<QString, QHash<QString, QString>> cached;
+};
+
+static IncludeGraph::FileIncludes scanWith(const QString& path, const QStringList& searchPaths, IncludeResolver *resolver)
+{
+    IncludeGraph::FileIncludes file{ path, -1, {} };
+    QFile f(path);
+    if (!f.open(QFile::ReadOnly))
+        return file;
+    auto text = QString::fromUtf8(f.readAll());
+    file.size = f.size();
+    auto dir = QFileInfo(path).absolutePath();
+    auto it = INCLUDE_RE.globalMatch(text);
+    while (it.hasNext()) {
+        auto m = it.next();
+        auto quoted = m.capturedRef(1) == "\"";
+        auto resolved = resolver->resolve(m.captured(2).trimmed(), quoted? dir : QString(), searchPaths);
+        if (!resolved.isEmpty() && !file.includes.contains(resolved))
+            file.includes.append(resolved);
+    }
+    return file;
+}
+
+QStringList IncludeGraph::searchPathsFromFlags(const QStringList &flags)
+{
+    QStringList paths;
+    for (int i = 0; i < flags.size(); i++) {
+        const auto& flag = flags.at(i);
+        if (SEARCH_PATH_OPTIONS.contains(flag)) {
+            if (i + 1 < flags.size())
+                paths.append(flags.at(++i));
+        } else {
+            for (const auto& opt: SEARCH_PATH_OPTIONS) {
+                if (flag.startsWith(opt)) {
+                    paths.append(flag.mid(opt.size()));
+                    break;
+                }
+            }
+        }
+    }
+    return paths;
+}
+
+bool IncludeGraph::isTranslationUnit(const QString &path)
+{
+    return TRANSLATION_UNIT_SUFFIXES.contains(QFileInfo(path).suffix());
+}
+
+IncludeGraph::FileIncludes IncludeGraph::scanFile(const QString &path, const QStringList &searchPaths)
+{
+    IncludeResolver resolver;
+    return scanWith(path, searchPaths, &resolver);
+}
+
+IncludeGraph IncludeGraph::build(const QHash<QString, QStringList> &sourceSearchPaths)
+{
+    IncludeGraph graph;
+    IncludeResolver resolver;
+    auto pathsOf = sourceSearchPaths;
+    auto queue = sourceSearchPaths.keys();
+    auto seen = queue.toSet();
+    while (!queue.isEmpty()) {
+        auto path = queue.takeLast();
+        auto paths = pathsOf.value(path);
+        auto file = scanWith(path, paths, &resolver);
+        for (const auto& inc: file.includes) {
+            if (!seen.contains(inc)) {
+                seen.insert(inc);
+                pathsOf.insert(inc, paths);
+                queue.append(inc);
+            }
+        }
+        graph.merge(file);
+    }
+    return graph;
+}
+
+void IncludeGraph::merge(const IncludeGraph::FileIncludes &file)
+{
+    for (const auto& old: edges.value(file.path))
+        reverseEdges[old].remove(file.path);
+    edges.insert(file.path, file.includes);
+    for (const auto& inc: file.includes)
+        reverseEdges[inc].insert(file.path);
+    sizes.insert(file.path, file.size);
+}
+
+void IncludeGraph::clear()
+{
+    edges.clear();
+    reverseEdges.clear();
+    sizes.clear();
+}
+
+QStringList IncludeGraph::affectedTranslationUnits(const QString &path) const
+{
+    QStringList units;
+    QSet<QString> seen{ path };
+    QStringList queue{ path };
+    while (!queue.isEmpty()) {
+        auto node = queue.takeLast();
+        if (isTranslationUnit(node))
+            units.append(node);
+        for (const auto& includer: reverseEdges.value(node)) {
+            if (!seen.contains(includer)) {
+                seen.insert(includer);
+                queue.append(includer);
+            }
+        }
+    }
+    units.sort();
+    return units;
+}
+
+ICodeModelProvider::IncludeCost IncludeGraph::costOf(const QString &path) const
+{
+    ICodeModelProvider::IncludeCost cost;
+    QSet<QString> seen{ path };
+    QStringList queue{ path };
+    while (!queue.isEmpty()) {
+        auto node = queue.takeLast();
+        cost.files++;
+        cost.bytes += qMax(sizes.value(node), qint64(0));
+        for (const auto& inc: edges.value(node)) {
+            if (!seen.contains(inc)) {
+                seen.insert(inc);
+                queue.append(inc);
+            }
+        }
+    }
+    auto units = affectedTranslationUnits(path);
+    cost.translationUnits = units.size() - (units.contains(path)? 1 : 0);
+    return cost;
+}
+
+ICodeModelProvider::IncludeCostMap IncludeGraph::headerCosts() const
+{
+    ICodeModelProvider::IncludeCostMap costs;
+    for (auto it = edges.begin(); it != edges.end(); ++it)
+        if (!isTranslationUnit(it.key()))
+            costs.insert(it.key(), costOf(it.key()));
+    return costs;
+}
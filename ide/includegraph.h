@@ -0,0 +1,61 @@
+/*
+ * This file is part of Embedded-IDE
+ *
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef INCLUDEGRAPH_H
+#define INCLUDEGRAPH_H
+
+#include "icodemodelprovider.h"
+
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+
+// Plain value so a snapshot can be handed to a worker thread
+class IncludeGraph
+{
+public:
+    struct FileIncludes {
+        QString path;
+        qint64 size{ -1 };
+        QStringList includes;
+    };
+
+    static QStringList searchPathsFromFlags(const QStringList& flags);
+    static bool isTranslationUnit(const QString& path);
+    static FileIncludes scanFile(const QString& path, const QStringList& searchPaths);
+    // Scans sources and follows every resolved include, headers take the search paths of whoever reached them first
+    static IncludeGraph build(const QHash<QString, QStringList>& sourceSearchPaths);
+
+    bool isEmpty() const { return edges.isEmpty(); }
+    bool contains(const QString& path) const { return edges.contains(path); }
+    void merge(const FileIncludes& file);
+    void clear();
+
+    QStringList includesOf(const QString& path) const { return edges.value(path); }
+    QStringList includersOf(const QString& path) const { return reverseEdges.value(path).toList(); }
+    QStringList affectedTranslationUnits(const QString& path) const;
+    ICodeModelProvider::IncludeCost costOf(const QString& path) const;
+    ICodeModelProvider::IncludeCostMap headerCosts() const;
+
+private:
+    QHash<QString, QStringList> edges;
+    QHash<QString, QSet<QString>> reverseEdges;
+    QHash<QString, qint64> sizes;
+};
+
+#endif // INCLUDEGRAPH_H
@@ -0,0 +1,162 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "linediff.h"
+
+#include <QHash>
+
+#include <cstring>
+#include <vector>
+
+namespace {
+
+struct Lines {
+    const char *data;
+    std::vector<int> starts; // one per line plus the end, relative to data
+    std::vector<uint> hashes;
+
+    Lines(const char *text, int begin, int end) : data(text + begin) {
+        int size = end - begin;
+        int pos = 0;
+        while (pos < size) {
+            starts.push_back(pos);
+            auto nl = static_cast<const char*>(std::memchr(data + pos, '\n', size_t(size - pos)));
+            pos = nl? int(nl - data) + 1 : size;
+        }
+        starts.push_back(size);
+        hashes.reserve(starts.size() - 1);
+        for (size_t i = 0; i + 1 < starts.size(); i++)
+            hashes.push_back(qHash(QByteArray::fromRawData(data + starts[i], starts[i + 1] - starts[i])));
+    }
+
+    int count() const { return int(starts.size()) - 1; }
+    int length(int i) const { return starts[size_t(i) + 1] - starts[size_t(i)]; }
+    const char *line(int i) const { return data + starts[size_t(i)]; }
+};
+
+bool sameLine(const Lines& a, int i, const Lines& b, int j)
+{
+    return a.hashes[size_t(i)] == b.hashes[size_t(j)] && a.length(i) == b.length(j) &&
+            std::memcmp(a.line(i), b.line(j), size_t(a.length(i))) == 0;
+}
+
+}
+
+TextEditList LineDiff::edits(const QByteArray &from, const QByteArray &to, int maxChanges)
+{
+    TextEditList result;
+    const char *a = from.constData();
+    const char *b = to.constData();
+    const int lenA = from.size();
+    const int lenB = to.size();
+
+    // Common head and tail cut back to line boundaries, most reloads end here
+    int head = 0;
+    while (head < lenA && head < lenB && a[head] == b[head])
+        head++;
+    if (head == lenA && head == lenB)
+        return result;
+    while (head > 0 && a[head - 1] != '\n')
+        head--;
+    int tail = 0;
+    while (tail < lenA - head && tail < lenB - head && a[lenA - 1 - tail] == b[lenB - 1 - tail])
+        tail++;
+    int endA = lenA - tail;
+    int endB = lenB - tail;
+    while (endA < lenA && endA > head && a[endA - 1] != '\n') {
+        endA++;
+        endB++;
+    }
+
+    Lines la(a, head, endA);
+    Lines lb(b, head, endB);
+    const int n = la.count();
+    const int m = lb.count();
+    auto addEdit = [&result, &la, &lb, head](int a0, int a1, int b0, int b1) {
+        auto offset = head + la.starts[size_t(a0)];
+        auto length = la.starts[size_t(a1)] - la.starts[size_t(a0)];
+        auto text = QByteArray(lb.data + lb.starts[size_t(b0)], lb.starts[size_t(b1)] - lb.starts[size_t(b0)]);
+        result.append(TextEdit{ offset, length, text });
+    };
+
+    // Myers, keeping the reachable diagonals of every step to walk the path back
+    const int maxD = qMin(n + m, maxChanges);
+    std::vector<int> v(size_t(2 * maxD + 3), 0);
+    const int offset = maxD + 1;
+    std::vector<std::vector<int>> trace;
+    int found = -1;
+    for (int d = 0; d <= maxD && found < 0; d++) {
+        trace.emplace_back(v.begin() + offset - d - 1, v.begin() + offset + d + 2);
+        for (int k = -d; k <= d; k += 2) {
+            int x;
+            if (k == -d || (k != d && v[size_t(offset + k - 1)] < v[size_t(offset + k + 1)]))
+                x = v[size_t(offset + k + 1)];
+            else
+                x = v[size_t(offset + k - 1)] + 1;
+            int y = x - k;
+            while (x < n && y < m && sameLine(la, x, lb, y)) {
+                x++;
+                y++;
+            }
+            v[size_t(offset + k)] = x;
+            if (x >= n && y >= m) {
+                found = d;
+                break;
+            }
+        }
+    }
+    if (found < 0) {
+        addEdit(0, n, 0, m);
+        return result;
+    }
+
+    std::vector<std::pair<int, int>> matches;
+    int x = n;
+    int y = m;
+    for (int d = found; d >= 0; d--) {
+        const auto& prev = trace[size_t(d)];
+        auto at = [&prev, d](int k) { return prev[size_t(k + d + 1)]; };
+        int k = x - y;
+        int prevK;
+        if (k == -d || (k != d && at(k - 1) < at(k + 1)))
+            prevK = k + 1;
+        else
+            prevK = k - 1;
+        int prevX = d > 0? at(prevK) : 0;
+        int prevY = d > 0? prevX - prevK : 0;
+        while (x > prevX && y > prevY) {
+            x--;
+            y--;
+            matches.emplace_back(x, y);
+        }
+        x = prevX;
+        y = prevY;
+    }
+
+    int ai = 0;
+    int bi = 0;
+    for (auto it = matches.rbegin(); it != matches.rend(); ++it) {
+        if (it->first > ai || it->second > bi)
+            addEdit(ai, it->first, bi, it->second);
+        ai = it->first + 1;
+        bi = it->second + 1;
+    }
+    if (ai < n || bi < m)
+        addEdit(ai, n, bi, m);
+    return result;
+}
@@ -0,0 +1,32 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef LINEDIFF_H
+#define LINEDIFF_H
+
+#include "textedit.h"
+
+class LineDiff
+{
+public:
+    // Byte edits over whole lines turning from into to, sorted by offset. Myers diff over
+    // the lines left after the common head and tail, one edit for the rest past maxChanges
+    static TextEditList edits(const QByteArray& from, const QByteArray& to, int maxChanges = 1000);
+};
+
+#endif // LINEDIFF_H
@@ -27,6 +27,7 @@
 #include "idocumenteditor.h"
 #include "externaltoolmanager.h"
 #include "processmanager.h"
+#include "projectformatter.h"
 #include "projectmanager.h"
 #include "unsavedfilesdialog.h"
 #include "version.h"
@@ -39,8 +40,11 @@
 #include "templatemanager.h"
 #include "templateitemwidget.h"
 #include "templatefile.h"
+#include "trigramindex.h"
 
 #include <QCloseEvent>
+#include <QCryptographicHash>
+#include <QDir>
 #include <QFileDialog>
 #include <QStringListModel>
 #include <QScrollBar>
@@ -70,16 +74,25 @@ public:
     ProcessManager *pman;
     ConsoleInterceptor *console;
     BuildManager *buildManager;
+    TrigramIndex *textIndex;
+    ProjectFormatter *projectFormatter;
     LineRangeList lineRanges;
     QString lastDir;
     bool documentOnly = false;
     QByteArray topSplitterState;
     QByteArray docSplitterState;
+    QString sessionFile;
 };
 
 
 static constexpr auto MAINWINDOW_SIZE = QSize{900, 600};
 
+static QString sessionFileFor(const QString& projectDir)
+{
+    auto id = QCryptographicHash::hash(projectDir.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QDir(AppConfig::instance().cachePath()).absoluteFilePath(QString("%1.session.json").arg(QString(id)));
+}
+
 static QString kindToIcon(const QString& kind)
 {
     static const QHash<QString, QString> map{
@@ -213,6 +226,8 @@ MainWindow::MainWindow(QWidget *parent) :
     priv->projectManager = new ProjectManager(ui->actionViewer, priv->pman, this);
     priv->buildManager = new BuildManager(priv->projectManager, priv->pman, this);
     priv->fileManager = new FileSystemManager(ui->fileViewer, this);
+    priv->textIndex = new TrigramIndex(this);
+    priv->projectFormatter = new ProjectFormatter(this);
     ui->documentContainer->setProjectManager(priv->projectManager);
     priv->projectManager->setCodeModelProvider(new ClangAutocompletionProvider(priv->projectManager, this));
 
@@ -247,7 +262,16 @@ MainWindow::MainWindow(QWidget *parent) :
             UnsavedFilesDialog d(unsaved, this);
             if (d.exec() == QDialog::Rejected)
                 return;
-            ui->documentContainer->saveDocuments(d.checkedForSave());
+            // Build once every file is on disk, the writes run in parallel
+            ui->documentContainer->saveDocuments(d.checkedForSave(), [this, target](bool ok) {
+                if (!ok) {
+                    TextMessageBrocker::instance().publish(TextMessages::STDERR_LOG,
+                                                           tr("Build of %1 canceled, some files could not be saved").arg(target));
+                    return;
+                }
+                priv->buildManager->startBuild(target);
+            });
+            return;
         }
         priv->buildManager->startBuild(target);
     });
@@ -350,10 +374,16 @@ MainWindow::MainWindow(QWidget *parent) :
         AppConfig::instance().save();
         qputenv("CURRENT_PROJECT_FILE", filepath.toLocal8Bit());
         qputenv("CURRENT_PROJECT_DIR", dirpath.toLocal8Bit());
+        if (AppConfig::instance().useTextIndex())
+            priv->textIndex->setRoot(dirpath);
+        priv->sessionFile = sessionFileFor(dirpath);
+        ui->documentContainer->restoreSession(priv->sessionFile);
     });
     connect(priv->projectManager, &ProjectManager::projectClosed, [this, makeRecentProjects]() {
         qputenv("CURRENT_PROJECT_FILE", "");
         qputenv("CURRENT_PROJECT_DIR", "");
+        if (!priv->sessionFile.isEmpty())
+            ui->documentContainer->saveSession(priv->sessionFile);
         bool ok = ui->documentContainer->aboutToCloseAll();
         qDebug() << "can close" << ok;
         if (ok) {
@@ -361,6 +391,8 @@ MainWindow::MainWindow(QWidget *parent) :
             makeRecentProjects();
             ui->stackedWidget->setCurrentWidget(ui->welcomePage);
             priv->fileManager->closePath();
+            priv->textIndex->setRoot(QString());
+            priv->sessionFile.clear();
         }
     });
 
@@ -475,8 +507,36 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(ui->buttonDocumentSaveAll, &QToolButton::clicked, ui->documentContainer, &DocumentManager::saveAll);
     connect(ui->buttonDocumentReload, &QToolButton::clicked, ui->documentContainer, &DocumentManager::reloadDocumentCurrent);
 
-    auto setExternalTools = [this]() {
+    connect(priv->projectFormatter, &ProjectFormatter::progress, [this](int done, int total) {
+        priv->projectManager->showMessage(tr("Formatting %1 of %2 files...").arg(done).arg(total));
+    });
+    connect(priv->projectFormatter, &ProjectFormatter::finished, [this](const ProjectFormatter::Summary& s) {
+        priv->projectManager->showMessageTimed(tr("Format finished"));
+        priv->console->writeMessage(tr("Formatted %1 files, %2 already formatted, %3 with unsaved changes skipped, %4 failed")
+                                    .arg(s.formatted).arg(s.unchanged).arg(s.skipped).arg(s.errors.size()), Qt::darkGreen);
+        for (const auto& e: s.messages + s.errors)
+            TextMessageBrocker::instance().publish(TextMessages::STDERR_LOG, e);
+    });
+    auto formatProject = [this]() {
+        if (!priv->projectManager->isProjectOpen() || priv->projectFormatter->isRunning())
+            return;
+        // Unsaved documents are left alone, clean ones reload through the file watcher
+        auto root = priv->projectManager->projectPath();
+        priv->projectFormatter->start(root, ProjectFormatter::sourceFilters(), ui->documentContainer->unsavedDocuments(),
+                                      [this, root](int files) {
+            // Files are rewritten in place with no undo, vendored trees included
+            return QMessageBox::question(this, tr("Format Project"),
+                                         tr("Format %1 C/C++ files under %2 in place?\nThis cannot be undone.")
+                                         .arg(files).arg(root)) == QMessageBox::Yes;
+        });
+    };
+    connect(new QShortcut(QKeySequence("CTRL+SHIFT+I"), this), &QShortcut::activated, formatProject);
+
+    auto setExternalTools = [this, formatProject]() {
         auto m = ExternalToolManager::makeMenu(this, priv->pman, priv->projectManager);
+        m->addSeparator();
+        m->addAction(QIcon(AppConfig::resourceImage({ "actions", "code-context" })),
+                     tr("Format Project"), formatProject)->setShortcut(QKeySequence("CTRL+SHIFT+I"));
         ui->buttonTools->setMenu(m);
         // ui->buttonExternalTools->setMenu(m);
     };
@@ -490,6 +550,12 @@ MainWindow::MainWindow(QWidget *parent) :
     });
 
     auto findInFilesDialog = new FindInFilesDialog(this);
+    findInFilesDialog->setTextIndex(priv->textIndex);
+    findInFilesDialog->setDocumentManager(ui->documentContainer);
+    connect(&AppConfig::instance(), &AppConfig::configChanged, [this](AppConfig *cfg) {
+        auto open = priv->projectManager->isProjectOpen();
+        priv->textIndex->setRoot(open && cfg->useTextIndex()? priv->projectManager->projectPath() : QString());
+    });
     auto findInFilesCallback = [this, findInFilesDialog]() {
         auto path = priv->projectManager->projectPath();
         if (!path.isEmpty()) {
@@ -533,6 +599,8 @@ void MainWindow::openProject(const QString &path)
 
 void MainWindow::closeEvent(QCloseEvent *event)
 {
+    if (!priv->sessionFile.isEmpty())
+        ui->documentContainer->saveSession(priv->sessionFile);
     auto unsaved = ui->documentContainer->unsavedDocuments();
     if (unsaved.isEmpty()) {
         event->accept();
@@ -69,6 +69,11 @@ bool MarkdownEditor::save(const QString &path) {
     return editor->save(path);
 }
 
+void MarkdownEditor::saveInBackground(const QString &path, SaveCallback_t done) {
+    setWindowFilePath(path);
+    editor->saveInBackground(path, done);
+}
+
 void MarkdownEditor::setPath(const QString &path) {
     editor->setPath(path);
     view->setWindowFilePath(path);
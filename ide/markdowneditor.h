@@ -18,10 +18,12 @@ public:
     virtual QWidget *widget() override { return this; }
     virtual bool load(const QString& path) override;
     virtual bool save(const QString& path) override;
+    virtual void saveInBackground(const QString& path, SaveCallback_t done) override;
     virtual void reload() override {
         editor->reload();
         updateView();
     }
+    virtual bool isSaving() const override { return editor->isSaving(); }
     virtual QString path() const override { return widget()->windowFilePath(); }
     virtual void setPath(const QString& path) override;
     virtual bool isReadonly() const override { return editor->isReadonly(); }
@@ -30,6 +32,10 @@ public:
     virtual void setModified(bool m) override { return editor->setModified(m); }
     virtual QPoint cursor() const override { return editor->cursor(); }
     virtual void setCursor(const QPoint& pos) override { editor->setCursor(pos); }
+    virtual int scrollLine() const override { return editor->scrollLine(); }
+    virtual void setScrollLine(int line) override { editor->setScrollLine(line); }
+    virtual qint64 memoryUsage() const override { return editor->memoryUsage(); }
+    virtual QWidget *createSplitView(QWidget *parent) override { return editor->createSplitView(parent); }
 
     static IDocumentEditorCreator *creator();
 
@@ -18,20 +18,37 @@
  */
 #include "appconfig.h"
 #include "formfindreplace.h"
+#include "linediff.h"
 #include "plaintexteditor.h"
+#include "replaceinfiles.h"
 #include "textmessagebrocker.h"
 
+#include <QCryptographicHash>
 #include <QDomDocument>
 #include <Qsci/qscistyle.h>
 #include <Qsci/qscilexer.h>
 
 #include <QFile>
+#include <QFileInfo>
 #include <QMenu>
 #include <QMessageBox>
+#include <QProgressBar>
+#include <QPointer>
 #include <QRegularExpression>
+#include <QSaveFile>
+#include <QTimer>
+#include <QtConcurrent>
 #include <QtDebug>
 
 #include <cmath>
+#include <limits>
+
+static constexpr int OCCURRENCES_SLICE = 256 * 1024;
+static constexpr int MAX_OCCURRENCES = 2000;
+static constexpr qint64 LARGE_FILE_THRESHOLD = 16 * 1024 * 1024;
+static constexpr qint64 LARGE_FILE_CHUNK = 4 * 1024 * 1024;
+static constexpr unsigned long VIEW_MARGINS = 5;
+static constexpr int MAX_WORD_COMPLETIONS = 100;
 
 PlainTextEditor::PlainTextEditor(QWidget *parent) : QsciScintilla(parent)
 {
@@ -40,22 +57,15 @@ PlainTextEditor::PlainTextEditor(QWidget *parent) : QsciScintilla(parent)
     connect(this, &QsciScintilla::linesChanged, this, &PlainTextEditor::adjustLineNumberMargin);
     connect(this, &QsciScintilla::cursorPositionChanged,
             [this](int line, int col) { notifyCursorOvserver(line + 1, col + 1); });
-    connect(this, &QsciScintilla::selectionChanged, [this](){
-        auto editorLength = SendScintilla(SCI_GETLENGTH);
-        SendScintilla(SCI_SETINDICATORCURRENT, 0);
-        SendScintilla(SCI_INDICATORCLEARRANGE, 0, editorLength);
-        auto word = selectedText();
-        if (!word.isEmpty()) {
-            int endpos = 0;
-            auto startpos = 0;
-            startpos = findText(word, SCFIND_WHOLEWORD, startpos, &endpos);
-            while(startpos != -1) {
-                SendScintilla(SCI_INDICATORFILLRANGE,
-                              static_cast<unsigned long>(startpos),
-                              endpos - startpos);
-                startpos = findText(word, SCFIND_WHOLEWORD, endpos + 1, &endpos);
-            }
-        }
+    occurrencesTimer = new QTimer(this);
+    occurrencesTimer->setInterval(0);
+    connect(occurrencesTimer, &QTimer::timeout, this, &PlainTextEditor::highlightOccurrencesSlice);
+    connect(this, &QsciScintilla::selectionChanged, this, &PlainTextEditor::highlightOccurrences);
+    connect(this, &QsciScintilla::textChanged, [this]() {
+        editRevision++;
+        // Pending ranges are stale once the text moves
+        occurrencesTimer->stop();
+        occurrences.pending.clear();
     });
     connect(this, &PlainTextEditor::modificationChanged, [this]() {
         notifyModifyObservers();
@@ -97,7 +107,7 @@ PlainTextEditor::PlainTextEditor(QWidget *parent) : QsciScintilla(parent)
         connect(acc, &QAction::triggered, functor);
         addAction(acc);
     };
-    mkAction("ctrl+s", [this]() { save(path()); });
+    mkAction("ctrl+s", [this]() { saveInBackground(path(), {}); });
     mkAction("ctrl+r", [this]() { load(path()); });
     mkAction("ctrl+space", [this]() { triggerAutocompletion(); });
     mkAction("ctrl+f", [findDialog]() { findDialog->show(); });
@@ -105,158 +115,224 @@ PlainTextEditor::PlainTextEditor(QWidget *parent) : QsciScintilla(parent)
 
 PlainTextEditor::~PlainTextEditor() = default;
 
-// NPP detect indent from nppIndenture writed by Evan King
-// https://github.com/evan-king/nppIndenture
-// Licenced by GPL-3.0
-namespace npp_detectident {
-
-constexpr auto MIN_INDENT = 2; // minimum width of a single indentation
-constexpr auto MAX_INDENT = 8; // maximum width of a single indentation
-
-constexpr auto MIN_DEPTH = MIN_INDENT; // ignore lines below this indentation level
-constexpr auto MAX_DEPTH = 3*MAX_INDENT; // ignore lines beyond this indentation level
-
-// % of lines allowed to contradict indentation option without penalty
-constexpr auto GRACE_FREQUENCY = 1 / 50.0F;
-
-struct ParseResult {
-    int num_tab_lines = 0;
-    int num_space_lines = 0;
-    float grace = 0.0F;
-
-    // indentation => count(lines of that exact indentation)
-    std::array<int, MAX_DEPTH+1> depth_counts = { { 0 } };
-};
-
-ParseResult parseDocument(QsciScintilla *doc) {
-    ParseResult result;
-
-    const int num_lines = doc->lines();
-    result.grace = float(num_lines) * GRACE_FREQUENCY;
-    for(int i = 0; i < num_lines; ++i) {
-        auto depth = static_cast<const decltype (result.depth_counts)::size_type>(doc->indentation(i));
-        if(depth < MIN_DEPTH || depth > MAX_DEPTH)
-            continue;
-
-        auto pos = doc->SendScintilla(QsciScintilla::SCI_POSITIONFROMLINE, i);
-        auto lineHeadChar = doc->SendScintilla(QsciScintilla::SCI_GETCHARAT, pos);
-
-        if(lineHeadChar == '\t') result.num_tab_lines++;
-
-        if(lineHeadChar == ' ') {
-            result.num_space_lines++;
-            result.depth_counts.at(depth)++;
-        }
+bool PlainTextEditor::load(const QString &path)
+{
+    if (isLargeFile(path))
+        return loadLarge(path);
+    if (loading.largeMode) {
+        finishLargeLoad();
+        loading.largeMode = false;
     }
-
-    return result;
+    if (!QFileInfo(path).isReadable())
+        return false;
+    setPath(path);
+    loadConfig();
+    // Read and profiled on a worker, the widget is filled once the text is ready
+    if (!loading.watcher)
+        loading.readOnly = QsciScintilla::isReadOnly();
+    loading.pendingCursor = QPoint();
+    loading.pendingScrollLine = -1;
+    QsciScintilla::setReadOnly(true);
+    auto watcher = new QFutureWatcher<LoadedText>(this);
+    loading.watcher = watcher;
+    connect(watcher, &QFutureWatcher<LoadedText>::finished, [this, watcher]() {
+        watcher->deleteLater();
+        if (loading.watcher != watcher)
+            return;
+        loading.watcher.clear();
+        QsciScintilla::setReadOnly(loading.readOnly);
+        auto loaded = watcher->result();
+        if (!loaded.error.isEmpty())
+            TextMessageBrocker::instance().publish(TextMessages::STDERR_LOG, loaded.error);
+        setLoadedText(loaded);
+        applyTextProfile();
+        setModified(false);
+        if (!loading.pendingCursor.isNull())
+            setCursor(loading.pendingCursor);
+        if (loading.pendingScrollLine >= 0)
+            setFirstVisibleLine(loading.pendingScrollLine);
+    });
+    watcher->setFuture(QtConcurrent::run(&PlainTextEditor::readText, path, AppConfig::instance().editorTabWidth()));
+    return true;
 }
 
-struct IndentInfo {
-    enum class IndentType { Invalid, Space, Tab };
-
-    IndentType type = IndentType::Invalid;
-    int num = 0;
-};
-
-IndentInfo detectIndentInfo(QsciScintilla *doc) {
-
-    const ParseResult result = parseDocument(doc);
-    IndentInfo info;
-
-    // decide `type`
-    if(result.num_tab_lines + result.num_space_lines == 0)
-        info.type = IndentInfo::IndentType::Invalid;
-    else if(result.num_space_lines > (result.num_tab_lines * 4))
-        info.type = IndentInfo::IndentType::Space;
-    else if(result.num_tab_lines > (result.num_space_lines * 4))
-        info.type = IndentInfo::IndentType::Tab;
-    /*else
-        {
-            const auto sci = plugin.getSciCallFunctor();
-            const bool useTab = sci.call<bool>(SCI_GETUSETABS);
-            info.type = useTab ? IndentType::Tab : IndentType::Space;
-        }*/
-
-    // decide `num`
-    if(info.type == IndentInfo::IndentType::Space) {
-
-        // indent size => count(space-indented lines with incompatible indentation)
-        std::array<int, MAX_INDENT+1> margins = {0};
-        using margins_size = decltype (margins)::size_type;
-
-        // for each depth option, count the incompatible lines
-        for(margins_size i = MIN_DEPTH; i <= MAX_DEPTH; i++) {
-            for(margins_size k = MIN_INDENT; k <= MAX_INDENT; k++) {
-                if(i % k == 0)
-                    continue;
-                margins.at(k) += result.depth_counts.at(i);
-            }
-        }
+PlainTextEditor::LoadedText PlainTextEditor::readText(const QString &path, int tabWidth)
+{
+    LoadedText loaded;
+    QFile f(path);
+    if (!f.open(QFile::ReadOnly)) {
+        loaded.error = tr("Cannot read %1: %2").arg(path, f.errorString());
+        return loaded;
+    }
+    // Mapped when possible, resources and empty files are read instead
+    QByteArray contents;
+    auto size = f.size();
+    auto data = reinterpret_cast<const char*>(size > 0? f.map(0, size) : nullptr);
+    if (!data) {
+        contents = f.readAll();
+        data = contents.constData();
+        size = contents.size();
+    }
+    loaded.checksum = QCryptographicHash::hash(QByteArray::fromRawData(data, static_cast<int>(size)), QCryptographicHash::Sha1);
+    // Encoding, line endings and indentation in one pass before Scintilla sees the text
+    loaded.profile = TextFileProfile::scan(data, static_cast<int>(size), tabWidth, &loaded.text);
+    if (loaded.text.isNull()) {
+        auto bom = loaded.profile.bomSize();
+        loaded.text = contents.isNull()? QByteArray(data + bom, static_cast<int>(size) - bom) : contents.mid(bom);
+    }
+    return loaded;
+}
 
-        // choose the last indent with the smallest margin (ties go to larger indent)
-        // Considers margins within grace of zero as =zero,
-        // so occasional typos don't force smaller indentation
-        margins_size which = MIN_INDENT;
-        for(margins_size i = MIN_INDENT; i <= MAX_INDENT; ++i) {
-            if(result.depth_counts.at(i) == 0) continue;
-            if(margins.at(i) <= margins.at(which) || margins.at(i) < result.grace) which = i;
-        }
+void PlainTextEditor::setLoadedText(const PlainTextEditor::LoadedText &loaded)
+{
+    textProfile = loaded.profile;
+    diskChecksum = loaded.checksum;
+    auto ro = QsciScintilla::isReadOnly();
+    QsciScintilla::setReadOnly(false);
+    SendScintilla(SCI_SETUNDOCOLLECTION, 0L);
+    SendScintilla(SCI_CLEARALL);
+    SendScintilla(SCI_ALLOCATE, static_cast<unsigned long>(loaded.text.size() + 1));
+    SendScintilla(SCI_APPENDTEXT, static_cast<unsigned long>(loaded.text.size()), loaded.text.constData());
+    SendScintilla(SCI_SETUNDOCOLLECTION, 1L);
+    SendScintilla(SCI_EMPTYUNDOBUFFER);
+    QsciScintilla::setReadOnly(ro);
+}
 
-        info.num = static_cast<int>(which);
+void PlainTextEditor::applyTextProfile()
+{
+    switch (textProfile.eol) {
+    case TextFileProfile::Eol::Unix: setEolMode(EolUnix); break;
+    case TextFileProfile::Eol::Windows: setEolMode(EolWindows); break;
+    case TextFileProfile::Eol::Mac: setEolMode(EolMac); break;
+    case TextFileProfile::Eol::Unknown: break;
+    }
+    if (!AppConfig::instance().editorDetectIdent())
+        return;
+    if (textProfile.indent == TextFileProfile::Indent::Tabs) {
+        setIndentationsUseTabs(true);
+    } else if (textProfile.indent == TextFileProfile::Indent::Spaces) {
+        setIndentationsUseTabs(false);
+        setIndentationWidth(textProfile.indentWidth);
     }
-
-    return info;
 }
 
+PlainTextEditor::WrittenText PlainTextEditor::writeText(const QString &path, const QByteArray &text, const TextFileProfile &profile)
+{
+    // Written back with the encoding and BOM it was read with, into a temporary file
+    // renamed over the original so a crash never leaves it truncated
+    WrittenText written;
+    auto bytes = profile.encode(text);
+    QSaveFile f(path);
+    if (!f.open(QFile::WriteOnly) || f.write(bytes) != bytes.size() || !f.commit())
+        written.error = tr("Cannot save %1: %2").arg(path, f.errorString());
+    else
+        written.checksum = QCryptographicHash::hash(bytes, QCryptographicHash::Sha1);
+    return written;
 }
 
-bool PlainTextEditor::load(const QString &path)
+bool PlainTextEditor::save(const QString &path)
 {
-    QFile f(path);
-    if (f.open(QFile::ReadOnly)) {
-        if (read(&f)) {
-            setPath(path);
-            loadConfig();
-            if (AppConfig::instance().editorDetectIdent()) {
-                auto info = npp_detectident::detectIndentInfo(this);
-                if (info.type == npp_detectident::IndentInfo::IndentInfo::IndentType::Tab) {
-                    setIndentationsUseTabs(true);
-                } else if (info.type == npp_detectident::IndentInfo::IndentInfo::IndentType::Space) {
-                    setIndentationsUseTabs(false);
-                    setIndentationWidth(info.num);
-                } else {
-                    // Nothing to do... fallback to config
-                }
-            }
-            return true;
-        }
+    if (isLoading())
+        return false;
+    auto length = static_cast<int>(SendScintilla(SCI_GETLENGTH));
+    auto buffer = static_cast<const char*>(SendScintillaPtrResult(SCI_GETCHARACTERPOINTER));
+    auto written = writeText(path, QByteArray::fromRawData(buffer, length), textProfile);
+    if (!written.error.isEmpty()) {
+        TextMessageBrocker::instance().publish(TextMessages::STDERR_LOG, written.error);
+        return false;
     }
-    return false;
+    diskChecksum = written.checksum;
+    setPath(path);
+    setModified(false);
+    return true;
 }
 
-bool PlainTextEditor::save(const QString &path)
+void PlainTextEditor::saveInBackground(const QString &path, IDocumentEditor::SaveCallback_t done)
 {
-    QFile f(path);
-    if (f.open(QFile::WriteOnly)) {
-        if (write(&f)) {
-            setPath(path);
-            setModified(false);
-            return true;
-        }
+    if (isLoading()) {
+        if (done)
+            done(false);
+        return;
     }
-    return false;
+    // The worker gets its own copy, editing goes on while it writes
+    auto length = static_cast<int>(SendScintilla(SCI_GETLENGTH));
+    auto buffer = static_cast<const char*>(SendScintillaPtrResult(SCI_GETCHARACTERPOINTER));
+    QByteArray snapshot(buffer, length);
+    auto revision = editRevision;
+    auto profile = textProfile;
+    // Saves of one document land in order
+    auto previous = lastSave;
+    lastSave = QtConcurrent::run([path, snapshot, profile, previous]() mutable {
+        previous.waitForFinished();
+        return writeText(path, snapshot, profile);
+    });
+    setPath(path);
+    pendingSaves++;
+    QPointer<QsciScintilla> self(this);
+    auto watcher = new QFutureWatcher<WrittenText>();
+    connect(watcher, &QFutureWatcher<WrittenText>::finished, [this, self, watcher, revision, done]() {
+        watcher->deleteLater();
+        auto written = watcher->result();
+        if (self)
+            pendingSaves--;
+        if (!written.error.isEmpty()) {
+            TextMessageBrocker::instance().publish(TextMessages::STDERR_LOG, written.error);
+        } else if (self) {
+            diskChecksum = written.checksum;
+            if (editRevision == revision)
+                setModified(false);
+        }
+        if (done)
+            done(written.error.isEmpty());
+    });
+    watcher->setFuture(lastSave);
 }
 
 void PlainTextEditor::reload()
 {
-    QFile f(path());
-    if (f.open(QFile::ReadOnly)) {
+    if (isLoading())
+        return;
+    if (loading.largeMode || isLargeFile(path())) {
         auto c = cursor();
-        read(&f);
-        setCursor(c);
-        setModified(false);
+        if (load(path()))
+            setCursor(c);
+        return;
     }
+    // Only the lines that differ from the file are replaced, undo history, markers,
+    // folds and styling of everything else stay as they are
+    auto length = static_cast<int>(SendScintilla(SCI_GETLENGTH));
+    auto buffer = static_cast<const char*>(SendScintillaPtrResult(SCI_GETCHARACTERPOINTER));
+    QByteArray snapshot(buffer, length);
+    auto known = diskChecksum;
+    auto revision = editRevision;
+    auto file = path();
+    auto tabWidth = AppConfig::instance().editorTabWidth();
+    auto watcher = new QFutureWatcher<ReloadedText>(this);
+    connect(watcher, &QFutureWatcher<ReloadedText>::finished, [this, watcher, revision]() {
+        watcher->deleteLater();
+        auto reloaded = watcher->result();
+        if (!reloaded.loaded.error.isEmpty()) {
+            TextMessageBrocker::instance().publish(TextMessages::STDERR_LOG, reloaded.loaded.error);
+            return;
+        }
+        // Same bytes on disk or typed over meanwhile, nothing to apply
+        if (reloaded.loaded.checksum.isNull() || editRevision != revision)
+            return;
+        textProfile = reloaded.loaded.profile;
+        diskChecksum = reloaded.loaded.checksum;
+        ReplaceInFiles::replaceTargets(this, 0, reloaded.edits);
+        applyTextProfile();
+        setModified(false);
+    });
+    watcher->setFuture(QtConcurrent::run([file, tabWidth, snapshot, known]() {
+        ReloadedText reloaded;
+        reloaded.loaded = readText(file, tabWidth);
+        if (reloaded.loaded.checksum == known)
+            reloaded.loaded.checksum.clear();
+        else if (reloaded.loaded.error.isEmpty())
+            reloaded.edits = LineDiff::edits(snapshot, reloaded.loaded.text);
+        return reloaded;
+    }));
 }
 
 bool PlainTextEditor::isReadonly() const
@@ -266,7 +342,11 @@ bool PlainTextEditor::isReadonly() const
 
 void PlainTextEditor::setReadonly(bool rdOnly)
 {
-    QsciScintilla::setReadOnly(rdOnly);
+    // Stays read only until the text is in
+    if (isLoading())
+        loading.readOnly = rdOnly;
+    else
+        QsciScintilla::setReadOnly(rdOnly);
 }
 
 bool PlainTextEditor::isModified() const
@@ -289,9 +369,80 @@ QPoint PlainTextEditor::cursor() const
 
 void PlainTextEditor::setCursor(const QPoint &pos)
 {
+    if (isLoading())
+        loading.pendingCursor = pos;
     setCursorPosition(pos.y() - 1, pos.x());
 }
 
+void PlainTextEditor::setScrollLine(int line)
+{
+    if (isLoading())
+        loading.pendingScrollLine = line;
+    setFirstVisibleLine(line);
+}
+
+qint64 PlainTextEditor::memoryUsage() const
+{
+    // Text plus one style byte per character and the line index, the undo stack is not exposed
+    return qint64(length()) * 2 + qint64(lines()) * 8;
+}
+
+QWidget *PlainTextEditor::createSplitView(QWidget *parent)
+{
+    // Text, styling, markers and fold levels live in the shared document, only view state is duplicated
+    auto view = new QsciScintilla(parent);
+    view->setDocument(document());
+    copyViewSettings(view);
+    connect(&AppConfig::instance(), &AppConfig::configChanged, view, [this, view]() { copyViewSettings(view); });
+    int line, index;
+    getCursorPosition(&line, &index);
+    view->setCursorPosition(line, index);
+    view->setFirstVisibleLine(firstVisibleLine());
+    return view;
+}
+
+void PlainTextEditor::copyViewSettings(QsciScintilla *view)
+{
+    // Style definitions are per view, the lexer only fills the shared style bytes
+    static const struct { unsigned int get, set; } STYLE_PROPERTIES[] = {
+        { SCI_STYLEGETFORE, SCI_STYLESETFORE },
+        { SCI_STYLEGETBACK, SCI_STYLESETBACK },
+        { SCI_STYLEGETSIZEFRACTIONAL, SCI_STYLESETSIZEFRACTIONAL },
+        { SCI_STYLEGETWEIGHT, SCI_STYLESETWEIGHT },
+        { SCI_STYLEGETITALIC, SCI_STYLESETITALIC },
+        { SCI_STYLEGETUNDERLINE, SCI_STYLESETUNDERLINE },
+        { SCI_STYLEGETEOLFILLED, SCI_STYLESETEOLFILLED },
+        { SCI_STYLEGETCASE, SCI_STYLESETCASE },
+        { SCI_STYLEGETVISIBLE, SCI_STYLESETVISIBLE },
+    };
+    for (unsigned long style = 0; style <= STYLE_MAX; style++) {
+        QByteArray fontName(int(SendScintilla(SCI_STYLEGETFONT, style, static_cast<void*>(nullptr))) + 1, '\0');
+        SendScintilla(SCI_STYLEGETFONT, style, static_cast<void*>(fontName.data()));
+        view->SendScintilla(SCI_STYLESETFONT, style, fontName.constData());
+        for (const auto& p: STYLE_PROPERTIES)
+            view->SendScintilla(p.set, style, SendScintilla(p.get, style));
+    }
+    for (unsigned long indic = 0; indic <= INDIC_MAX; indic++) {
+        view->SendScintilla(SCI_INDICSETSTYLE, indic, SendScintilla(SCI_INDICGETSTYLE, indic));
+        view->SendScintilla(SCI_INDICSETFORE, indic, SendScintilla(SCI_INDICGETFORE, indic));
+        view->SendScintilla(SCI_INDICSETALPHA, indic, SendScintilla(SCI_INDICGETALPHA, indic));
+        view->SendScintilla(SCI_INDICSETUNDER, indic, SendScintilla(SCI_INDICGETUNDER, indic));
+    }
+    view->setFolding(folding());
+    for (unsigned long margin = 0; margin < VIEW_MARGINS; margin++) {
+        view->SendScintilla(SCI_SETMARGINTYPEN, margin, SendScintilla(SCI_GETMARGINTYPEN, margin));
+        view->SendScintilla(SCI_SETMARGINWIDTHN, margin, SendScintilla(SCI_GETMARGINWIDTHN, margin));
+        view->SendScintilla(SCI_SETMARGINMASKN, margin, SendScintilla(SCI_GETMARGINMASKN, margin));
+    }
+    view->setIndentationGuides(indentationGuides());
+    view->setWhitespaceVisibility(whitespaceVisibility());
+    view->setWrapMode(wrapMode());
+    view->setCaretLineVisible(SendScintilla(SCI_GETCARETLINEVISIBLE) != 0);
+    view->SendScintilla(SCI_SETCARETLINEBACK, SendScintilla(SCI_GETCARETLINEBACK));
+    view->SendScintilla(SCI_SETMULTIPLESELECTION, 1L, 0L);
+    view->SendScintilla(SCI_SETADDITIONALSELECTIONTYPING, 1L, 0L);
+}
+
 class PlainTextEditorCreator: public IDocumentEditorCreator
 {
 public:
@@ -311,6 +462,98 @@ IDocumentEditorCreator *PlainTextEditor::creator()
     return IDocumentEditorCreator::staticCreator<PlainTextEditorCreator>();
 }
 
+bool PlainTextEditor::isLargeFile(const QString &path)
+{
+    return QFileInfo(path).size() > LARGE_FILE_THRESHOLD;
+}
+
+bool PlainTextEditor::loadLarge(const QString &path)
+{
+    auto file = new QFile(path, this);
+    if (!file->open(QFile::ReadOnly)) {
+        delete file;
+        return false;
+    }
+    // Scintilla positions are int
+    if (file->size() > std::numeric_limits<int>::max()) {
+        TextMessageBrocker::instance().publish(TextMessages::STDERR_LOG,
+                                               tr("%1 is too large to open").arg(path));
+        delete file;
+        return false;
+    }
+    if (loading.largeFile)
+        finishLargeLoad();
+    else if (!loading.watcher)
+        loading.readOnly = QsciScintilla::isReadOnly();
+    loading.watcher.clear();
+    loading.largeMode = true;
+    loading.largeFile = file;
+    loading.pendingCursor = QPoint();
+    loading.pendingScrollLine = -1;
+    textProfile = TextFileProfile();
+    setPath(path);
+    setLexer(nullptr);
+    loadConfig();
+    setWrapMode(WrapNone);
+    // No undo history for the load itself, the buffer is sized once up front
+    SendScintilla(SCI_SETUNDOCOLLECTION, 0L);
+    QsciScintilla::setReadOnly(false);
+    SendScintilla(SCI_CLEARALL);
+    SendScintilla(SCI_ALLOCATE, static_cast<unsigned long>(file->size() + 1));
+    QsciScintilla::setReadOnly(true);
+
+    loading.progress = new QProgressBar(viewport());
+    loading.progress->setRange(0, 100);
+    loading.progress->setFormat(tr("Loading %p%"));
+    loading.progress->adjustSize();
+    loading.progress->move(viewport()->width() - loading.progress->width() - 8, 8);
+    loading.progress->show();
+    QTimer::singleShot(0, this, &PlainTextEditor::loadNextChunk);
+    return true;
+}
+
+void PlainTextEditor::loadNextChunk()
+{
+    auto file = loading.largeFile;
+    if (!file)
+        return;
+    // One chunk per event loop turn, the editor can be scrolled and read while the rest comes in
+    auto chunk = file->read(LARGE_FILE_CHUNK);
+    if (!chunk.isEmpty()) {
+        QsciScintilla::setReadOnly(false);
+        SendScintilla(SCI_APPENDTEXT, static_cast<unsigned long>(chunk.size()), chunk.constData());
+        QsciScintilla::setReadOnly(true);
+        SendScintilla(SCI_SETSAVEPOINT);
+        loading.progress->setValue(static_cast<int>(file->pos() * 100 / qMax(file->size(), qint64(1))));
+    }
+    if (chunk.isEmpty() && !file->atEnd())
+        TextMessageBrocker::instance().publish(TextMessages::STDERR_LOG,
+                                               tr("Error reading %1: %2").arg(file->fileName(), file->errorString()));
+    else if (!file->atEnd()) {
+        QTimer::singleShot(0, this, &PlainTextEditor::loadNextChunk);
+        return;
+    }
+    finishLargeLoad();
+    if (!loading.pendingCursor.isNull())
+        setCursor(loading.pendingCursor);
+    if (loading.pendingScrollLine >= 0)
+        setFirstVisibleLine(loading.pendingScrollLine);
+}
+
+void PlainTextEditor::finishLargeLoad()
+{
+    if (!loading.largeFile)
+        return;
+    delete loading.largeFile;
+    loading.largeFile = nullptr;
+    delete loading.progress;
+    loading.progress = nullptr;
+    SendScintilla(SCI_SETUNDOCOLLECTION, 1L);
+    SendScintilla(SCI_EMPTYUNDOBUFFER);
+    SendScintilla(SCI_SETSAVEPOINT);
+    QsciScintilla::setReadOnly(loading.readOnly);
+}
+
 QString PlainTextEditor::wordUnderCursor() const
 {
     int line;
@@ -325,6 +568,76 @@ void PlainTextEditor::adjustLineNumberMargin()
     setMarginWidth(0, m.width(QString().fill('0', 2 + static_cast<int>(std::log10(lines())))));
 }
 
+void PlainTextEditor::highlightOccurrences()
+{
+    occurrencesTimer->stop();
+    occurrences.pending.clear();
+    SendScintilla(SCI_SETINDICATORCURRENT, 0);
+    if (occurrences.count > 0)
+        SendScintilla(SCI_INDICATORCLEARRANGE, 0, SendScintilla(SCI_GETLENGTH));
+    occurrences.count = 0;
+    auto word = selectedText();
+    // A single character or several lines would light up most of the document
+    if (word.length() < 2 || word.contains('\n'))
+        return;
+    occurrences.word = textAsBytes(word);
+    // Visible lines first, the rest of the document on idle slices
+    auto length = static_cast<int>(SendScintilla(SCI_GETLENGTH));
+    auto firstVisible = SendScintilla(SCI_GETFIRSTVISIBLELINE);
+    auto firstLine = SendScintilla(SCI_DOCLINEFROMVISIBLE, static_cast<unsigned long>(firstVisible));
+    auto lastLine = SendScintilla(SCI_DOCLINEFROMVISIBLE,
+                                  static_cast<unsigned long>(firstVisible + SendScintilla(SCI_LINESONSCREEN)));
+    auto visibleStart = static_cast<int>(SendScintilla(SCI_POSITIONFROMLINE, static_cast<unsigned long>(firstLine)));
+    auto visibleEnd = static_cast<int>(SendScintilla(SCI_GETLINEENDPOSITION, static_cast<unsigned long>(lastLine)));
+    if (!highlightOccurrencesIn(visibleStart, visibleEnd))
+        return;
+    occurrences.pending = { { visibleEnd, length }, { 0, visibleStart } };
+    occurrencesTimer->start();
+}
+
+void PlainTextEditor::highlightOccurrencesSlice()
+{
+    while (!occurrences.pending.isEmpty() && occurrences.pending.first().first >= occurrences.pending.first().second)
+        occurrences.pending.removeFirst();
+    if (occurrences.pending.isEmpty()) {
+        occurrencesTimer->stop();
+        return;
+    }
+    auto& range = occurrences.pending.first();
+    auto sliceEnd = qMin(range.second, range.first + OCCURRENCES_SLICE);
+    if (highlightOccurrencesIn(range.first, sliceEnd))
+        range.first = sliceEnd;
+}
+
+bool PlainTextEditor::highlightOccurrencesIn(int from, int to)
+{
+    // [from, to) bounds where a match starts, so ranges split anywhere never miss or repeat one
+    const auto& word = occurrences.word;
+    auto length = static_cast<int>(SendScintilla(SCI_GETLENGTH));
+    auto targetEnd = qMin(length, to + word.size() - 1);
+    SendScintilla(SCI_SETSEARCHFLAGS, SCFIND_WHOLEWORD);
+    SendScintilla(SCI_SETINDICATORCURRENT, 0);
+    while (from < to) {
+        SendScintilla(SCI_SETTARGETSTART, static_cast<unsigned long>(from));
+        SendScintilla(SCI_SETTARGETEND, static_cast<unsigned long>(targetEnd));
+        auto pos = SendScintilla(SCI_SEARCHINTARGET, static_cast<unsigned long>(word.size()), word.constData());
+        if (pos == -1)
+            break;
+        auto end = static_cast<int>(SendScintilla(SCI_GETTARGETEND));
+        if (++occurrences.count > MAX_OCCURRENCES) {
+            // Too common to be worth marking
+            occurrencesTimer->stop();
+            occurrences.pending.clear();
+            occurrences.count = 0;
+            SendScintilla(SCI_INDICATORCLEARRANGE, 0, length);
+            return false;
+        }
+        SendScintilla(SCI_INDICATORFILLRANGE, static_cast<unsigned long>(pos), end - static_cast<int>(pos));
+        from = end;
+    }
+    return true;
+}
+
 int PlainTextEditor::findText(const QString &text, int flags, int start, int *targend)
 {
     ScintillaBytes s = textAsBytes(text);
@@ -393,7 +706,7 @@ void PlainTextEditor::loadConfigWithStyle(const QString& styleName, const QFont&
     setBraceMatching(StrictBraceMatch);
     resetMatchedBraceIndicator();
     setBackspaceUnindents(true);
-    setFolding(CircledTreeFoldStyle);
+    setFolding(loading.largeMode? NoFoldStyle : CircledTreeFoldStyle);
     setIndentationGuides(true);
 
     setCaretLineVisible(true);
@@ -433,6 +746,7 @@ void PlainTextEditor::loadConfig()
 {
     auto &conf = AppConfig::instance();
     loadConfigWithStyle(conf.editorStyle(), conf.editorFont(), conf.editorTabWidth(), conf.editorTabsToSpaces());
+    applyTextProfile();
 }
 
 bool PlainTextEditor::loadStyle(const QString &xmlStyleFile)
@@ -595,7 +909,31 @@ void PlainTextEditor::triggerAutocompletion()
     int _;
     if (!apiContext(int(SendScintilla(SCI_GETCURRENTPOS)), _, _).isEmpty())
         autoCompleteFromDocument();
-    else {
+    else if (codeModel()) {
+        auto position = SendScintilla(SCI_GETCURRENTPOS);
+        auto start = SendScintilla(SCI_WORDSTARTPOSITION, static_cast<unsigned long>(position), true);
+        auto prefix = text(static_cast<int>(start), static_cast<int>(position));
+        QPointer<QsciScintilla> self(this);
+        codeModel()->wordCompletions(prefix, MAX_WORD_COMPLETIONS, [this, self, prefix](const QStringList& words) {
+            if (!self)
+                return;
+            // Project words come ranked by use, words only seen in this buffer go after them
+            auto list = words;
+            auto seen = words.toSet();
+            for (const auto& w: allWords()) {
+                if (w.startsWith(prefix) && !seen.contains(w)) {
+                    seen.insert(w);
+                    list.append(w);
+                }
+            }
+            if (list.isEmpty())
+                return;
+            // Ranked order only for this list, the others expect the default presorted one
+            SendScintilla(SCI_AUTOCSETORDER, SC_ORDER_CUSTOM);
+            showUserList(1, list);
+            SendScintilla(SCI_AUTOCSETORDER, SC_ORDER_PRESORTED);
+        });
+    } else {
         showUserList(1, allWords());
     }
 }
@@ -619,6 +957,13 @@ QMenu *PlainTextEditor::createContextualMenu()
     mkAction(isSelected, "edit-delete", tr("Delete"), "DEL", [this]() { removeSelectedText(); });
     m->addSeparator();
     mkAction(true, "edit-select-all", tr("Select All"), "CTRL+A", [this]() { selectAll(); });
+    auto man = documentManager();
+    if (man) {
+        m->addSeparator();
+        m->addAction(tr("Split Side by Side"), [man]() { man->splitCurrent(Qt::Horizontal); })->setShortcut(QKeySequence("CTRL+SHIFT+H"));
+        m->addAction(tr("Split Top and Bottom"), [man]() { man->splitCurrent(Qt::Vertical); })->setShortcut(QKeySequence("CTRL+SHIFT+V"));
+        m->addAction(tr("Remove Splits"), [man]() { man->unsplitCurrent(); })->setShortcut(QKeySequence("CTRL+SHIFT+W"));
+    }
 
     return m;
 }
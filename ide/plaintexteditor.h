@@ -22,6 +22,18 @@
 #include <idocumenteditor.h>
 #include <Qsci/qsciscintilla.h>
 
+#include "textedit.h"
+#include "textfileprofile.h"
+
+#include <QFutureWatcher>
+#include <QPair>
+#include <QPointer>
+#include <QVector>
+
+class QFile;
+class QProgressBar;
+class QTimer;
+
 class PlainTextEditor : public IDocumentEditor, public QsciScintilla
 {
 public:
@@ -32,15 +44,24 @@ public:
     QWidget *widget() override { return this; }
     bool load(const QString &path) override;
     bool save(const QString &path) override;
+    void saveInBackground(const QString &path, SaveCallback_t done) override;
     void reload() override;
+    bool isSaving() const override { return pendingSaves > 0; }
     virtual bool isReadonly() const override;
     void setReadonly(bool rdOnly) override;
     bool isModified() const override;
     void setModified(bool m) override;
     QPoint cursor() const override;
     void setCursor(const QPoint &pos) override;
+    int scrollLine() const override { return firstVisibleLine(); }
+    void setScrollLine(int line) override;
+    qint64 memoryUsage() const override;
+    QWidget *createSplitView(QWidget *parent) override;
 
     static IDocumentEditorCreator *creator();
+    // Past a size threshold files open as plain text, in chunks, without lexer or folding
+    static bool isLargeFile(const QString& path);
+    bool isLargeFileMode() const { return loading.largeMode; }
 
     QString wordUnderCursor() const;
 
@@ -53,6 +74,9 @@ public slots:
 private slots:
     void adjustLineNumberMargin();
     int findText(const QString &text, int flags, int start, int *targend);
+    void highlightOccurrences();
+    void highlightOccurrencesSlice();
+    void loadNextChunk();
 
 protected:
     void closeEvent(QCloseEvent *event) override;
@@ -62,6 +86,58 @@ protected:
     QStringList allWords();
 
     virtual QMenu *createContextualMenu();
+    // Bumped on every text change, for results computed off a snapshot of the buffer
+    quint64 textRevision() const { return editRevision; }
+
+private:
+    struct LoadedText {
+        TextFileProfile profile;
+        QByteArray text; // UTF-8 without BOM
+        QByteArray checksum; // of the bytes on disk
+        QString error;
+    };
+
+    struct WrittenText {
+        QByteArray checksum;
+        QString error;
+    };
+
+    struct ReloadedText {
+        LoadedText loaded;
+        TextEditList edits;
+    };
+
+    static LoadedText readText(const QString& path, int tabWidth);
+    static WrittenText writeText(const QString& path, const QByteArray& text, const TextFileProfile& profile);
+    void setLoadedText(const LoadedText& loaded);
+    bool isLoading() const { return loading.largeFile || loading.watcher; }
+    void applyTextProfile();
+    void copyViewSettings(QsciScintilla *view);
+    bool highlightOccurrencesIn(int from, int to);
+    bool loadLarge(const QString& path);
+    void finishLargeLoad();
+
+    struct {
+        bool largeMode{ false };
+        QFile *largeFile{ nullptr }; // only while appending chunks
+        QProgressBar *progress{ nullptr };
+        QPointer<QFutureWatcher<LoadedText>> watcher; // only while reading on a worker
+        bool readOnly{ false };
+        QPoint pendingCursor;
+        int pendingScrollLine{ -1 };
+    } loading;
+    QFuture<WrittenText> lastSave;
+    QByteArray diskChecksum;
+    int pendingSaves{ 0 };
+    quint64 editRevision{ 0 };
+
+    struct {
+        QByteArray word;
+        QVector<QPair<int, int>> pending; // match start ranges still to scan
+        int count{ 0 };
+    } occurrences;
+    QTimer *occurrencesTimer{ nullptr };
+    TextFileProfile textProfile;
 };
 
 #endif // PLAINTEXTEDITOR_H
@@ -0,0 +1,558 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "preprocessorregions.h"
+
+#include <QStack>
+
+#include <cstring>
+
+static constexpr int MAX_EXPANSION_DEPTH = 16;
+
+static inline bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
+
+static inline bool isIdentChar(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// Recursive descent over the C conditional expression grammar, identifiers are
+// replaced by the value of their macro as a nested expression
+class ExpressionParser
+{
+public:
+    ExpressionParser(const QByteArray& text, const PreprocessorRegions::MacroMap& macros,
+                     const PreprocessorRegions::MacroSet *undefined, int depth) :
+        p(text.constData()), end(text.constData() + text.size()), macros(macros), undefined(undefined), depth(depth)
+    {
+    }
+
+    qint64 parse(bool *ok) {
+        auto v = conditional();
+        skipBlanks();
+        *ok = !failed && p == end;
+        return v;
+    }
+
+private:
+    const char *p;
+    const char *end;
+    const PreprocessorRegions::MacroMap& macros;
+    const PreprocessorRegions::MacroSet *undefined;
+    int depth;
+    bool failed{ false };
+
+    void skipBlanks() {
+        while (p < end && (isBlank(*p) || *p == '\n' || *p == '\\'))
+            p++;
+    }
+
+    // notNext keeps "&" from eating the first half of "&&" and the like
+    bool accept(const char *op, char notNext = 0) {
+        skipBlanks();
+        auto n = int(std::strlen(op));
+        if (end - p < n || std::memcmp(p, op, size_t(n)) != 0)
+            return false;
+        if (notNext && end - p > n && p[n] == notNext)
+            return false;
+        p += n;
+        return true;
+    }
+
+    void expect(const char *op) {
+        if (!accept(op))
+            failed = true;
+    }
+
+    // Macros in neither set may come from a header, that makes the whole expression unknown
+    bool isDefined(const QByteArray& name) {
+        if (macros.contains(name))
+            return true;
+        if (undefined && !undefined->contains(name))
+            failed = true;
+        return false;
+    }
+
+    QByteArray identifier() {
+        skipBlanks();
+        auto start = p;
+        while (p < end && isIdentChar(*p))
+            p++;
+        return QByteArray(start, int(p - start));
+    }
+
+    qint64 conditional() {
+        auto c = logicalOr();
+        if (accept("?")) {
+            auto a = conditional();
+            expect(":");
+            auto b = conditional();
+            return c? a : b;
+        }
+        return c;
+    }
+
+    qint64 logicalOr() {
+        auto v = logicalAnd();
+        while (accept("||")) {
+            auto r = logicalAnd();
+            v = v || r;
+        }
+        return v;
+    }
+
+    qint64 logicalAnd() {
+        auto v = bitOr();
+        while (accept("&&")) {
+            auto r = bitOr();
+            v = v && r;
+        }
+        return v;
+    }
+
+    qint64 bitOr() {
+        auto v = bitXor();
+        while (accept("|", '|'))
+            v |= bitXor();
+        return v;
+    }
+
+    qint64 bitXor() {
+        auto v = bitAnd();
+        while (accept("^"))
+            v ^= bitAnd();
+        return v;
+    }
+
+    qint64 bitAnd() {
+        auto v = equality();
+        while (accept("&", '&'))
+            v &= equality();
+        return v;
+    }
+
+    qint64 equality() {
+        auto v = relational();
+        for (;;) {
+            if (accept("=="))
+                v = v == relational();
+            else if (accept("!="))
+                v = v != relational();
+            else
+                return v;
+        }
+    }
+
+    qint64 relational() {
+        auto v = shift();
+        for (;;) {
+            if (accept("<="))
+                v = v <= shift();
+            else if (accept(">="))
+                v = v >= shift();
+            else if (accept("<", '<'))
+                v = v < shift();
+            else if (accept(">", '>'))
+                v = v > shift();
+            else
+                return v;
+        }
+    }
+
+    qint64 shift() {
+        auto v = additive();
+        for (;;) {
+            if (accept("<<"))
+                v = qint64(quint64(v) << (additive() & 63));
+            else if (accept(">>"))
+                v >>= (additive() & 63);
+            else
+                return v;
+        }
+    }
+
+    qint64 additive() {
+        auto v = multiplicative();
+        for (;;) {
+            if (accept("+"))
+                v = qint64(quint64(v) + quint64(multiplicative()));
+            else if (accept("-"))
+                v = qint64(quint64(v) - quint64(multiplicative()));
+            else
+                return v;
+        }
+    }
+
+    qint64 multiplicative() {
+        auto v = unary();
+        for (;;) {
+            bool div = false;
+            if (accept("*")) {
+                v = qint64(quint64(v) * quint64(unary()));
+                continue;
+            } else if (accept("/")) {
+                div = true;
+            } else if (!accept("%")) {
+                return v;
+            }
+            auto r = unary();
+            if (r == 0) {
+                failed = true;
+                return 0;
+            }
+            // INT64_MIN / -1 traps, wrap it like the other operators
+            if (r == -1)
+                v = div? qint64(0 - quint64(v)) : 0;
+            else
+                v = div? v / r : v % r;
+        }
+    }
+
+    qint64 unary() {
+        if (accept("!", '='))
+            return !unary();
+        if (accept("~"))
+            return ~unary();
+        if (accept("-"))
+            return qint64(0 - quint64(unary()));
+        if (accept("+"))
+            return unary();
+        return primary();
+    }
+
+    qint64 primary() {
+        if (failed)
+            return 0;
+        skipBlanks();
+        if (p == end) {
+            failed = true;
+            return 0;
+        }
+        if (accept("(")) {
+            auto v = conditional();
+            expect(")");
+            return v;
+        }
+        if (*p >= '0' && *p <= '9')
+            return number();
+        if (*p == '\'')
+            return character();
+        auto name = identifier();
+        if (name.isEmpty()) {
+            failed = true;
+            return 0;
+        }
+        if (name == "defined") {
+            bool paren = accept("(");
+            auto macro = identifier();
+            if (paren)
+                expect(")");
+            if (macro.isEmpty())
+                failed = true;
+            return isDefined(macro);
+        }
+        if (name == "true")
+            return 1;
+        if (name == "false")
+            return 0;
+        skipBlanks();
+        // Function like macros and builtins such as __has_include are not expanded
+        if (p < end && *p == '(') {
+            failed = true;
+            return 0;
+        }
+        auto it = macros.find(name);
+        if (it == macros.end())
+            return isDefined(name);
+        if (it->trimmed().isEmpty() || depth >= MAX_EXPANSION_DEPTH) {
+            failed = true;
+            return 0;
+        }
+        bool ok;
+        auto v = ExpressionParser(it.value(), macros, undefined, depth + 1).parse(&ok);
+        if (!ok)
+            failed = true;
+        return v;
+    }
+
+    qint64 number() {
+        auto start = p;
+        while (p < end && (isIdentChar(*p) || *p == '\''))
+            p++;
+        auto token = QByteArray(start, int(p - start)).replace('\'', "");
+        while (!token.isEmpty() && (token.endsWith('u') || token.endsWith('U') ||
+                                    token.endsWith('l') || token.endsWith('L')))
+            token.chop(1);
+        bool ok;
+        qint64 v;
+        if (token.startsWith("0b") || token.startsWith("0B"))
+            v = qint64(token.mid(2).toULongLong(&ok, 2));
+        else
+            v = qint64(token.toULongLong(&ok, 0));
+        if (!ok)
+            failed = true;
+        return v;
+    }
+
+    qint64 character() {
+        p++;
+        qint64 v = 0;
+        if (p < end && *p == '\\') {
+            p++;
+            if (p == end) {
+                failed = true;
+                return 0;
+            }
+            switch (*p) {
+            case 'n': v = '\n'; break;
+            case 't': v = '\t'; break;
+            case 'r': v = '\r'; break;
+            case '0': v = 0; break;
+            default: v = *p; break;
+            }
+        } else if (p < end) {
+            v = *p;
+        }
+        p++;
+        if (p >= end || *p != '\'')
+            failed = true;
+        else
+            p++;
+        return v;
+    }
+};
+
+qint64 PreprocessorRegions::evaluate(const QByteArray &expression, const MacroMap &macros, bool *ok,
+                                     const MacroSet *undefined)
+{
+    return ExpressionParser(expression, macros, undefined, 0).parse(ok);
+}
+
+// A quote ending a number is a digit separator, as in 1'000
+static bool isDigitSeparator(const char *s, int i)
+{
+    int start = i;
+    while (start > 0 && isIdentChar(s[start - 1]))
+        start--;
+    return start < i && s[start] >= '0' && s[start] <= '9';
+}
+
+// Drops comments from a directive, inComment tells whether a block comment is left open
+static QByteArray stripComments(const QByteArray& text, bool *inComment)
+{
+    QByteArray out;
+    out.reserve(text.size());
+    for (int i = 0; i < text.size(); i++) {
+        if (*inComment) {
+            if (text.at(i) == '*' && i + 1 < text.size() && text.at(i + 1) == '/') {
+                *inComment = false;
+                i++;
+                out.append(' ');
+            }
+        } else if (text.at(i) == '"' || (text.at(i) == '\'' && !isDigitSeparator(text.constData(), i))) {
+            auto quote = text.at(i);
+            out.append(quote);
+            for (i++; i < text.size() && text.at(i) != quote; i++) {
+                if (text.at(i) == '\\' && i + 1 < text.size())
+                    out.append(text.at(i++));
+                out.append(text.at(i));
+            }
+            if (i < text.size())
+                out.append(quote);
+        } else if (text.at(i) == '/' && i + 1 < text.size() && text.at(i + 1) == '*') {
+            *inComment = true;
+            i++;
+        } else if (text.at(i) == '/' && i + 1 < text.size() && text.at(i + 1) == '/') {
+            break;
+        } else {
+            out.append(text.at(i));
+        }
+    }
+    return out;
+}
+
+static void trackComments(const char *s, int size, bool *inComment)
+{
+    for (int i = 0; i < size; i++) {
+        if (*inComment) {
+            if (s[i] == '*' && i + 1 < size && s[i + 1] == '/') {
+                *inComment = false;
+                i++;
+            }
+        } else if (s[i] == '"' || (s[i] == '\'' && !isDigitSeparator(s, i))) {
+            // Comment markers inside string and char literals do not count
+            auto quote = s[i];
+            for (i++; i < size && s[i] != quote; i++)
+                if (s[i] == '\\')
+                    i++;
+        } else if (s[i] == '/' && i + 1 < size && s[i + 1] == '/') {
+            return;
+        } else if (s[i] == '/' && i + 1 < size && s[i + 1] == '*') {
+            *inComment = true;
+            i++;
+        }
+    }
+}
+
+PreprocessorRegions::LineRanges PreprocessorRegions::inactiveLines(const QByteArray &text, MacroMap macros)
+{
+    struct Group {
+        bool parentActive;
+        bool taken; // some branch already compiled
+        bool active;
+        bool unknown; // a condition could not be evaluated, every branch stays visible
+    };
+    QStack<Group> groups;
+    LineRanges ranges;
+    auto isActive = [&groups]() { return groups.isEmpty() || groups.top().active; };
+    auto mark = [&ranges](int first, int last) {
+        if (!ranges.isEmpty() && ranges.last().second == first - 1)
+            ranges.last().second = last;
+        else
+            ranges.append(qMakePair(first, last));
+    };
+    // Headers are not read, past the first #include only macros defined or undefined
+    // so far are known and conditions on any other one stay visible
+    bool included = false;
+    MacroSet undefined;
+    auto condition = [&macros, &included, &undefined](const QByteArray& keyword, const QByteArray& args, bool *ok) -> bool {
+        if (keyword == "if" || keyword == "elif")
+            return PreprocessorRegions::evaluate(args, macros, ok, included? &undefined : nullptr) != 0;
+        auto name = args.trimmed();
+        int n = 0;
+        while (n < name.size() && isIdentChar(name.at(n)))
+            n++;
+        name.truncate(n);
+        *ok = !name.isEmpty();
+        bool defined = macros.contains(name);
+        if (!defined && included && !undefined.contains(name))
+            *ok = false;
+        return keyword.endsWith("ndef")? !defined : defined;
+    };
+
+    const char *s = text.constData();
+    const int size = text.size();
+    bool inComment = false;
+    int line = 0;
+    for (int pos = 0; pos < size;) {
+        auto eol = static_cast<const char*>(std::memchr(s + pos, '\n', size_t(size - pos)));
+        int next = eol? int(eol - s) + 1 : size;
+        int i = pos;
+        while (i < next && isBlank(s[i]))
+            i++;
+        if (inComment || i == next || s[i] != '#') {
+            if (!isActive())
+                mark(line, line);
+            trackComments(s + pos, next - pos, &inComment);
+            pos = next;
+            line++;
+            continue;
+        }
+
+        // Directive, joined with its continuation lines
+        int firstLine = line;
+        QByteArray directive;
+        for (;;) {
+            int lineEnd = next;
+            while (lineEnd > pos && (s[lineEnd - 1] == '\n' || s[lineEnd - 1] == '\r'))
+                lineEnd--;
+            bool continued = lineEnd > pos && s[lineEnd - 1] == '\\' && next < size;
+            directive.append(s + pos, (continued? lineEnd - 1 : lineEnd) - pos);
+            pos = next;
+            if (!continued)
+                break;
+            line++;
+            eol = static_cast<const char*>(std::memchr(s + pos, '\n', size_t(size - pos)));
+            next = eol? int(eol - s) + 1 : size;
+        }
+        directive = stripComments(directive, &inComment).trimmed().mid(1).trimmed();
+        int k = 0;
+        while (k < directive.size() && isIdentChar(directive.at(k)))
+            k++;
+        auto keyword = directive.left(k);
+        auto args = directive.mid(k).trimmed();
+
+        bool dimmed;
+        if (keyword == "if" || keyword == "ifdef" || keyword == "ifndef") {
+            Group g{ isActive(), false, false, false };
+            dimmed = !g.parentActive;
+            if (g.parentActive) {
+                bool ok;
+                g.active = condition(keyword, args, &ok);
+                if (!ok) {
+                    g.unknown = true;
+                    g.active = true;
+                }
+                g.taken = g.active;
+            }
+            groups.push(g);
+        } else if (keyword == "elif" || keyword == "elifdef" || keyword == "elifndef" || keyword == "else") {
+            if (groups.isEmpty()) {
+                dimmed = false;
+            } else {
+                auto& g = groups.top();
+                dimmed = !g.parentActive;
+                if (!g.parentActive) {
+                    g.active = false;
+                } else if (g.unknown) {
+                    g.active = true;
+                } else if (g.taken) {
+                    g.active = false;
+                } else if (keyword == "else") {
+                    g.active = true;
+                } else {
+                    bool ok;
+                    g.active = condition(keyword, args, &ok);
+                    if (!ok) {
+                        g.unknown = true;
+                        g.active = true;
+                    }
+                }
+                g.taken = g.taken || g.active;
+            }
+        } else if (keyword == "endif") {
+            dimmed = !groups.isEmpty() && !groups.top().parentActive;
+            if (!groups.isEmpty())
+                groups.pop();
+        } else {
+            dimmed = !isActive();
+            if (!dimmed && (keyword == "include" || keyword == "include_next" || keyword == "import"))
+                included = true;
+            if (!dimmed && (keyword == "define" || keyword == "undef")) {
+                int n = 0;
+                while (n < args.size() && isIdentChar(args.at(n)))
+                    n++;
+                auto name = args.left(n);
+                if (keyword == "undef") {
+                    macros.remove(name);
+                    undefined.insert(name);
+                } else if (n < args.size() && args.at(n) == '(')
+                    macros.insert(name, QByteArray()); // function like, only defined() is meaningful
+                else if (!name.isEmpty())
+                    macros.insert(name, args.mid(n).trimmed());
+            }
+        }
+        if (dimmed)
+            mark(firstLine, line);
+        line++;
+    }
+    return ranges;
+}
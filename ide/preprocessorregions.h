@@ -0,0 +1,47 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PREPROCESSORREGIONS_H
+#define PREPROCESSORREGIONS_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QPair>
+#include <QSet>
+#include <QVector>
+
+// Conditional directives of one file evaluated against the predefined macros, plain
+// values so it can run on a worker thread
+class PreprocessorRegions
+{
+public:
+    using MacroMap = QHash<QByteArray, QByteArray>;
+    using MacroSet = QSet<QByteArray>;
+    using LineRanges = QVector<QPair<int, int>>; // first and last line, 0 based
+
+    // Lines inside branches that are not compiled, conditions that cannot be evaluated
+    // (function like macros, malformed expressions, macros that an included header
+    // may define) count as compiled
+    static LineRanges inactiveLines(const QByteArray& text, MacroMap macros);
+    // Value of a #if expression, ok is false when it cannot be evaluated. Given undefined,
+    // a macro in neither set makes it unknown instead of counting as 0
+    static qint64 evaluate(const QByteArray& expression, const MacroMap& macros, bool *ok,
+                           const MacroSet *undefined = nullptr);
+};
+
+#endif // PREPROCESSORREGIONS_H
@@ -0,0 +1,247 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "projectformatter.h"
+#include "appconfig.h"
+#include "codeformatter.h"
+#include "cpptexteditor.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPointer>
+#include <QSaveFile>
+#include <QSet>
+#include <QtConcurrent>
+
+using HashMap = QHash<QString, QByteArray>; // relative path to hash of options and content
+
+struct FileList {
+    QStringList files;
+    HashMap hashes;
+};
+
+struct FormatResult {
+    enum Status { Formatted, Unchanged, Skipped, Failed };
+
+    QString path;
+    Status status{ Failed };
+    QByteArray hash; // of what is on disk once done, empty when unknown
+    QString error;
+    QString message; // from AStyle
+};
+
+static QByteArray formatHash(const QByteArray& options, const QByteArray& content)
+{
+    QCryptographicHash h(QCryptographicHash::Sha1);
+    h.addData(options);
+    h.addData("\0", 1);
+    h.addData(content);
+    return h.result().toHex();
+}
+
+static HashMap readHashes(const QString& cacheFile)
+{
+    HashMap hashes;
+    QFile f(cacheFile);
+    if (f.open(QFile::ReadOnly)) {
+        auto o = QJsonDocument::fromJson(f.readAll()).object();
+        for (auto it = o.constBegin(); it != o.constEnd(); ++it)
+            hashes.insert(it.key(), it.value().toString().toLatin1());
+    }
+    return hashes;
+}
+
+static void writeHashes(const QString& cacheFile, const HashMap& hashes)
+{
+    QJsonObject o;
+    for (auto it = hashes.constBegin(); it != hashes.constEnd(); ++it)
+        o.insert(it.key(), QString::fromLatin1(it.value()));
+    QSaveFile f(cacheFile);
+    if (f.open(QFile::WriteOnly)) {
+        f.write(QJsonDocument(o).toJson(QJsonDocument::Compact));
+        f.commit();
+    }
+}
+
+struct FileFormatter {
+    using result_type = FormatResult;
+
+    QDir root;
+    QByteArray options;
+    HashMap hashes;
+    QSet<QString> exclude;
+
+    FormatResult operator()(const QString& path) const {
+        FormatResult result;
+        result.path = path;
+        if (exclude.contains(path)) {
+            result.status = FormatResult::Skipped;
+            return result;
+        }
+        QFile in(path);
+        if (!in.open(QFile::ReadOnly)) {
+            result.error = in.errorString();
+            return result;
+        }
+        auto content = in.readAll();
+        in.close();
+        result.hash = formatHash(options, content);
+        if (hashes.value(root.relativeFilePath(path)) == result.hash) {
+            result.status = FormatResult::Unchanged;
+            return result;
+        }
+        auto formatted = CodeFormatter::format(content, options, &result.message);
+        if (formatted == content) {
+            result.status = FormatResult::Unchanged;
+            return result;
+        }
+        QSaveFile out(path);
+        if (!out.open(QFile::WriteOnly) || out.write(formatted) != formatted.size() || !out.commit()) {
+            result.error = out.errorString();
+            result.hash.clear();
+            return result;
+        }
+        result.status = FormatResult::Formatted;
+        result.hash = formatHash(options, formatted);
+        return result;
+    }
+};
+
+class ProjectFormatter::Priv_t
+{
+public:
+    QPointer<QFutureWatcher<FileList>> listWatcher;
+    QPointer<QFutureWatcher<FormatResult>> formatWatcher;
+};
+
+ProjectFormatter::ProjectFormatter(QObject *parent) :
+    QObject(parent),
+    priv(std::make_unique<Priv_t>())
+{
+}
+
+ProjectFormatter::~ProjectFormatter()
+{
+    cancel();
+}
+
+bool ProjectFormatter::isRunning() const
+{
+    return priv->listWatcher || priv->formatWatcher;
+}
+
+QStringList ProjectFormatter::sourceFilters()
+{
+    QStringList filters;
+    for (const auto& suffix: CPPTextEditor::sourceSuffixes())
+        filters.append("*." + suffix);
+    return filters;
+}
+
+void ProjectFormatter::start(const QString &directory, const QStringList &filters, const QStringList &exclude,
+                             ConfirmCallback_t confirm)
+{
+    cancel();
+    auto root = QDir(QFileInfo(directory).absoluteFilePath());
+    auto id = QCryptographicHash::hash(root.absolutePath().toUtf8(), QCryptographicHash::Sha1).toHex();
+    auto cacheFile = QDir(AppConfig::instance().cachePath()).absoluteFilePath(QString("%1.format.json").arg(QString(id)));
+    // Options come from the editor settings, read them here and not on the workers
+    auto options = CodeFormatter::options();
+    QSet<QString> excluded;
+    for (const auto& path: exclude)
+        excluded.insert(QFileInfo(path).absoluteFilePath());
+
+    auto listWatcher = new QFutureWatcher<FileList>(this);
+    priv->listWatcher = listWatcher;
+    connect(listWatcher, &QFutureWatcher<FileList>::finished, [this, listWatcher, root, cacheFile, options, excluded, confirm]() {
+        listWatcher->deleteLater();
+        if (priv->listWatcher != listWatcher)
+            return;
+        priv->listWatcher.clear();
+        auto list = listWatcher->result();
+        if (list.files.isEmpty()) {
+            emit finished(Summary());
+            return;
+        }
+        if (confirm && !confirm(list.files.size()))
+            return;
+        auto watcher = new QFutureWatcher<FormatResult>(this);
+        priv->formatWatcher = watcher;
+        connect(watcher, &QFutureWatcher<FormatResult>::progressValueChanged, [this, watcher](int value) {
+            if (priv->formatWatcher == watcher)
+                emit progress(value, watcher->progressMaximum());
+        });
+        auto previous = list.hashes;
+        connect(watcher, &QFutureWatcher<FormatResult>::finished, [this, watcher, root, cacheFile, previous]() {
+            watcher->deleteLater();
+            Summary summary;
+            QSet<QString> messages;
+            // Canceled runs still record what got done, files gone from the tree are dropped
+            HashMap hashes;
+            for (const auto& result: watcher->future().results()) {
+                auto relative = root.relativeFilePath(result.path);
+                // Skipped files were not looked at, what was known of them still holds
+                auto hash = result.status == FormatResult::Skipped? previous.value(relative) : result.hash;
+                if (!hash.isEmpty())
+                    hashes.insert(relative, hash);
+                if (!result.message.isEmpty() && !messages.contains(result.message)) {
+                    messages.insert(result.message);
+                    summary.messages.append(result.message);
+                }
+                switch (result.status) {
+                case FormatResult::Formatted: summary.formatted++; break;
+                case FormatResult::Unchanged: summary.unchanged++; break;
+                case FormatResult::Skipped: summary.skipped++; break;
+                case FormatResult::Failed:
+                    summary.errors.append(QString("%1: %2").arg(result.path, result.error));
+                    break;
+                }
+            }
+            QtConcurrent::run(writeHashes, cacheFile, hashes);
+            if (priv->formatWatcher != watcher)
+                return;
+            priv->formatWatcher.clear();
+            emit finished(summary);
+        });
+        watcher->setFuture(QtConcurrent::mapped(list.files, FileFormatter{ root, options, list.hashes, excluded }));
+    });
+    listWatcher->setFuture(QtConcurrent::run([root, filters, cacheFile]() {
+        FileList list;
+        list.hashes = readHashes(cacheFile);
+        QDirIterator it(root.absolutePath(), filters, QDir::Files | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+        while (it.hasNext())
+            list.files.append(it.next());
+        return list;
+    }));
+}
+
+void ProjectFormatter::cancel()
+{
+    if (priv->listWatcher)
+        priv->listWatcher->cancel();
+    if (priv->formatWatcher)
+        priv->formatWatcher->cancel();
+    priv->listWatcher.clear();
+    priv->formatWatcher.clear();
+}
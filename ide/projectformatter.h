@@ -0,0 +1,68 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PROJECTFORMATTER_H
+#define PROJECTFORMATTER_H
+
+#include <QObject>
+#include <QStringList>
+
+#include <functional>
+#include <memory>
+
+// Runs the bundled AStyle over a whole tree on the global thread pool. Files whose
+// content did not change since they were last formatted with the same options are
+// skipped, the hashes are kept per project in the cache directory
+class ProjectFormatter : public QObject
+{
+    Q_OBJECT
+public:
+    struct Summary {
+        int formatted{ 0 };
+        int unchanged{ 0 }; // already formatted, or skipped by hash
+        int skipped{ 0 }; // unsaved in an editor
+        QStringList errors; // files that could not be read or written
+        QStringList messages; // from AStyle, each once, the output is still used as in the editor
+    };
+    // Told how many files matched on the GUI thread, false stops before anything is written
+    using ConfirmCallback_t = std::function<bool (int files)>;
+
+    explicit ProjectFormatter(QObject *parent = nullptr);
+    virtual ~ProjectFormatter() override;
+
+    bool isRunning() const;
+
+    // Name filters of the C and C++ sources, from the suffixes the C/C++ editor opens
+    static QStringList sourceFilters();
+
+signals:
+    void progress(int done, int total);
+    void finished(const ProjectFormatter::Summary& summary);
+
+public slots:
+    // Files in exclude are counted as skipped and never written, e.g. documents with unsaved changes
+    void start(const QString& directory, const QStringList& filters, const QStringList& exclude,
+               ConfirmCallback_t confirm);
+    void cancel();
+
+private:
+    class Priv_t;
+    std::unique_ptr<Priv_t> priv;
+};
+
+#endif // PROJECTFORMATTER_H
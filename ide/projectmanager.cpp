@@ -26,6 +26,7 @@
 #include "textmessagebrocker.h"
 
 #include <QBuffer>
+#include <QCryptographicHash>
 #include <QFileInfo>
 #include <QFileSystemModel>
 #include <QGridLayout>
@@ -109,6 +110,16 @@ static QPair<targetMap_t, targetMap_t> findAllTargets(QIODevice *in)
     return map;
 }
 
+static QByteArray makeDatabaseSignature(const QByteArray& database)
+{
+    // Comments carry timestamps and statistics that change on every run
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    for(const auto& line: database.split('\n'))
+        if (!line.startsWith('#'))
+            hash.addData(line);
+    return hash.result();
+}
+
 ProjectManager::ProjectManager(QListView *view, ProcessManager *pman, QObject *parent) :
     QObject(parent),
     priv(std::make_unique<Priv_t>())
@@ -135,7 +146,10 @@ ProjectManager::ProjectManager(QListView *view, ProcessManager *pman, QObject *p
     priv->pman->setTerminationHandler(DISCOVER_PROC, [this](QProcess *make, int code, QProcess::ExitStatus status) {
         Q_UNUSED(code)
         if (status == QProcess::NormalExit) {
-            auto res = findAllTargets(make);
+            auto database = make->readAll();
+            QBuffer buffer(&database);
+            buffer.open(QIODevice::ReadOnly);
+            auto res = findAllTargets(&buffer);
             priv->allTargets = res.first;
             priv->allRefs = res.second;
             const auto targetKeys = priv->allTargets.keys();
@@ -157,6 +171,7 @@ ProjectManager::ProjectManager(QListView *view, ProcessManager *pman, QObject *p
                     connect(button, &QPushButton::clicked, [t, this](){ emit targetTriggered(t); });
                 }
             }
+            emit makeDatabaseUpdated(makeDatabaseSignature(database));
         }
         showMessageTimed(tr("Finish target discover"));
     });
@@ -59,6 +59,7 @@ signals:
     void requestFileOpen(const QString& path);
     void exportFinish(const QString& exportMessage);
     void indexFinished();
+    void makeDatabaseUpdated(const QByteArray& signature);
 
 public slots:
     void createProject(const QString& projectFilePath, const QString& templateFile);
@@ -0,0 +1,272 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "replaceinfiles.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QFile>
+#include <QFutureWatcher>
+#include <QPointer>
+#include <QSaveFile>
+#include <QtConcurrent>
+
+#include <Qsci/qsciscintilla.h>
+
+struct ApplyResult {
+    QString path;
+    int count{ 0 };
+    QString error;
+};
+
+struct EditComputer {
+    using result_type = ReplaceInFiles::FileEdits;
+
+    FindInFilesEngine::MatcherPtr matcher;
+    QString replacement;
+
+    ReplaceInFiles::FileEdits operator()(const ReplaceInFiles::Source& source) const {
+        ReplaceInFiles::FileEdits file;
+        file.path = source.path;
+        file.inEditor = source.inEditor;
+        auto content = source.content;
+        if (!source.inEditor) {
+            QFile f(source.path);
+            if (!f.open(QFile::ReadOnly))
+                return file;
+            content = f.readAll();
+        }
+        file.checksum = ReplaceInFiles::checksum(content);
+        file.edits = FindInFilesEngine::replacementsIn(content, matcher, replacement);
+        return file;
+    }
+};
+
+static ApplyResult writeEdits(const ReplaceInFiles::FileEdits& file)
+{
+    ApplyResult result{ file.path, 0, QString() };
+    QFile in(file.path);
+    if (!in.open(QFile::ReadOnly)) {
+        result.error = in.errorString();
+        return result;
+    }
+    auto content = in.readAll();
+    in.close();
+    if (ReplaceInFiles::checksum(content) != file.checksum) {
+        result.error = QCoreApplication::translate("ReplaceInFiles", "modified since the preview");
+        return result;
+    }
+    // Written to a temporary beside the target and renamed over it, never half written
+    QSaveFile out(file.path);
+    if (!out.open(QFile::WriteOnly)) {
+        result.error = out.errorString();
+        return result;
+    }
+    out.write(ReplaceInFiles::applyEdits(content, file.edits));
+    if (!out.commit()) {
+        result.error = out.errorString();
+        return result;
+    }
+    result.count = file.edits.size();
+    return result;
+}
+
+class ReplaceInFiles::Priv_t
+{
+public:
+    QPointer<QFutureWatcher<FileEdits>> computeWatcher;
+    QPointer<QFutureWatcher<ApplyResult>> applyWatcher;
+};
+
+ReplaceInFiles::ReplaceInFiles(QObject *parent) :
+    QObject(parent),
+    priv(std::make_unique<Priv_t>())
+{
+}
+
+ReplaceInFiles::~ReplaceInFiles()
+{
+    cancel();
+}
+
+bool ReplaceInFiles::isRunning() const
+{
+    return priv->computeWatcher || priv->applyWatcher;
+}
+
+QByteArray ReplaceInFiles::checksum(const QByteArray &content)
+{
+    return QCryptographicHash::hash(content, QCryptographicHash::Sha1);
+}
+
+QByteArray ReplaceInFiles::applyEdits(const QByteArray &content, const TextEditList &edits)
+{
+    QByteArray out;
+    int growth = 0;
+    for (const auto& e: edits)
+        growth += e.text.size() - e.length;
+    out.reserve(content.size() + qMax(growth, 0));
+    int from = 0;
+    for (const auto& e: edits) {
+        out.append(content.constData() + from, e.offset - from);
+        out.append(e.text);
+        from = e.offset + e.length;
+    }
+    out.append(content.constData() + from, content.size() - from);
+    return out;
+}
+
+QString ReplaceInFiles::preview(const QByteArray &content, const TextEditList &edits)
+{
+    QString text;
+    int line = 1;
+    int counted = 0;
+    for (int i = 0; i < edits.size();) {
+        // Whole lines around the edit, edits sharing a line go in the same hunk
+        auto offset = edits.at(i).offset;
+        int start = offset > 0? content.lastIndexOf('\n', offset - 1) + 1 : 0;
+        int end = content.indexOf('\n', edits.at(i).offset + edits.at(i).length);
+        if (end == -1)
+            end = content.size();
+        TextEditList hunk;
+        for (; i < edits.size() && edits.at(i).offset <= end; i++) {
+            auto e = edits.at(i);
+            auto editEnd = content.indexOf('\n', e.offset + e.length);
+            end = qMax(end, editEnd == -1? content.size() : editEnd);
+            e.offset -= start;
+            hunk.append(e);
+        }
+        line += content.mid(counted, start - counted).count('\n');
+        counted = start;
+        auto before = content.mid(start, end - start);
+        auto after = applyEdits(before, hunk);
+        text += QString("@@ %1\n").arg(line);
+        for (const auto& l: QString::fromUtf8(before).split('\n'))
+            text += QString("- %1\n").arg(l);
+        for (const auto& l: QString::fromUtf8(after).split('\n'))
+            text += QString("+ %1\n").arg(l);
+    }
+    return text;
+}
+
+bool ReplaceInFiles::applyToEditor(QsciScintilla *editor, const ReplaceInFiles::FileEdits &file)
+{
+    auto length = int(editor->SendScintilla(QsciScintillaBase::SCI_GETLENGTH));
+    auto buffer = static_cast<const char*>(editor->SendScintillaPtrResult(QsciScintillaBase::SCI_GETCHARACTERPOINTER));
+    if (checksum(QByteArray::fromRawData(buffer, length)) != file.checksum)
+        return false;
+    replaceTargets(editor, 0, file.edits);
+    return true;
+}
+
+void ReplaceInFiles::replaceTargets(QsciScintilla *editor, int base, const TextEditList &edits)
+{
+    if (edits.isEmpty())
+        return;
+    // Back to front so offsets stay valid and the gap only moves one way, one undo
+    // step for the whole replace and a single repaint at the end
+    editor->viewport()->setUpdatesEnabled(false);
+    editor->beginUndoAction();
+    for (int i = edits.size() - 1; i >= 0; i--) {
+        const auto& e = edits.at(i);
+        editor->SendScintilla(QsciScintillaBase::SCI_SETTARGETSTART, static_cast<unsigned long>(base + e.offset));
+        editor->SendScintilla(QsciScintillaBase::SCI_SETTARGETEND, static_cast<unsigned long>(base + e.offset + e.length));
+        editor->SendScintilla(QsciScintillaBase::SCI_REPLACETARGET, static_cast<unsigned long>(e.text.size()), e.text.constData());
+    }
+    editor->endUndoAction();
+    editor->viewport()->setUpdatesEnabled(true);
+}
+
+void ReplaceInFiles::compute(const ReplaceInFiles::SourceList &sources, const FindInFilesEngine::Query &query, const QString &replacement)
+{
+    cancel();
+    auto matcher = FindInFilesEngine::compile(query);
+    if (!matcher) {
+        emit editsReady(FileEditsList());
+        return;
+    }
+    auto watcher = new QFutureWatcher<FileEdits>(this);
+    priv->computeWatcher = watcher;
+    connect(watcher, &QFutureWatcher<FileEdits>::progressValueChanged, [this, watcher](int value) {
+        if (priv->computeWatcher == watcher)
+            emit progress(value, watcher->progressMaximum());
+    });
+    connect(watcher, &QFutureWatcher<FileEdits>::finished, [this, watcher]() {
+        watcher->deleteLater();
+        if (priv->computeWatcher != watcher)
+            return;
+        priv->computeWatcher.clear();
+        FileEditsList files;
+        for (const auto& file: watcher->future().results())
+            if (!file.edits.isEmpty())
+                files.append(file);
+        emit editsReady(files);
+    });
+    watcher->setFuture(QtConcurrent::mapped(sources, EditComputer{ matcher, replacement }));
+}
+
+void ReplaceInFiles::apply(const ReplaceInFiles::FileEditsList &files)
+{
+    cancel();
+    FileEditsList onDisk;
+    for (const auto& file: files)
+        if (!file.inEditor)
+            onDisk.append(file);
+    auto watcher = new QFutureWatcher<ApplyResult>(this);
+    priv->applyWatcher = watcher;
+    connect(watcher, &QFutureWatcher<ApplyResult>::progressValueChanged, [this, watcher](int value) {
+        if (priv->applyWatcher == watcher)
+            emit progress(value, watcher->progressMaximum());
+    });
+    connect(watcher, &QFutureWatcher<ApplyResult>::finished, [this, watcher]() {
+        watcher->deleteLater();
+        if (priv->applyWatcher != watcher)
+            return;
+        priv->applyWatcher.clear();
+        int written = 0;
+        int replacements = 0;
+        QStringList errors;
+        for (const auto& result: watcher->future().results()) {
+            if (result.error.isEmpty()) {
+                written++;
+                replacements += result.count;
+            } else {
+                errors.append(QString("%1: %2").arg(result.path, result.error));
+            }
+        }
+        emit applied(written, replacements, errors);
+    });
+    watcher->setFuture(QtConcurrent::mapped(onDisk, writeEdits));
+}
+
+void ReplaceInFiles::cancelCompute()
+{
+    if (priv->computeWatcher)
+        priv->computeWatcher->cancel();
+    priv->computeWatcher.clear();
+}
+
+void ReplaceInFiles::cancel()
+{
+    if (priv->computeWatcher)
+        priv->computeWatcher->cancel();
+    if (priv->applyWatcher)
+        priv->applyWatcher->cancel();
+    priv->computeWatcher.clear();
+    priv->applyWatcher.clear();
+}
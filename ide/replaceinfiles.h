@@ -0,0 +1,82 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef REPLACEINFILES_H
+#define REPLACEINFILES_H
+
+#include "findinfilesengine.h"
+
+#include <QObject>
+#include <QStringList>
+
+#include <memory>
+
+class QsciScintilla;
+
+class ReplaceInFiles : public QObject
+{
+    Q_OBJECT
+public:
+    // Text to edit, content is taken from the editor buffer for open documents
+    struct Source {
+        QString path;
+        QByteArray content;
+        bool inEditor;
+    };
+    using SourceList = QVector<Source>;
+
+    struct FileEdits {
+        QString path;
+        QByteArray checksum; // of the text the edits were computed on
+        bool inEditor{ false };
+        TextEditList edits;
+    };
+    using FileEditsList = QVector<FileEdits>;
+
+    explicit ReplaceInFiles(QObject *parent = nullptr);
+    virtual ~ReplaceInFiles() override;
+
+    bool isRunning() const;
+
+    static QByteArray checksum(const QByteArray& content);
+    static QByteArray applyEdits(const QByteArray& content, const TextEditList& edits);
+    static QString preview(const QByteArray& content, const TextEditList& edits);
+    // Edits the buffer in one undo action, false when it changed since the edits were computed
+    static bool applyToEditor(QsciScintilla *editor, const FileEdits& file);
+    // Same without the check, edit offsets are relative to base
+    static void replaceTargets(QsciScintilla *editor, int base, const TextEditList& edits);
+
+signals:
+    void editsReady(const ReplaceInFiles::FileEditsList& files);
+    void progress(int done, int total);
+    void applied(int files, int replacements, const QStringList& errors);
+
+public slots:
+    void compute(const ReplaceInFiles::SourceList& sources, const FindInFilesEngine::Query& query, const QString& replacement);
+    // Writes files on disk, documents open in an editor are left to applyToEditor
+    void apply(const ReplaceInFiles::FileEditsList& files);
+    void cancel();
+    // Leaves a running apply alone, stopping it halfway would leave the files half replaced
+    void cancelCompute();
+
+private:
+    class Priv_t;
+    std::unique_ptr<Priv_t> priv;
+};
+
+#endif // REPLACEINFILES_H
@@ -0,0 +1,81 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "appconfig.h"
+#include "replacepreviewdialog.h"
+#include "ui_replacepreviewdialog.h"
+
+#include <QDir>
+#include <QFile>
+#include <QPushButton>
+
+ReplacePreviewDialog::ReplacePreviewDialog(const ReplaceInFiles::FileEditsList &files,
+                                           const QHash<QString, QByteArray> &editorContents,
+                                           const QString &rootPath,
+                                           QWidget *parent) :
+    QDialog(parent),
+    ui(std::make_unique<Ui::ReplacePreviewDialog>()),
+    files(files),
+    editorContents(editorContents)
+{
+    ui->setupUi(this);
+    ui->diffView->setFont(AppConfig::instance().loggerFont());
+    int replacements = 0;
+    for (const auto& file: files) {
+        auto name = rootPath.isEmpty()? file.path : QDir(rootPath).relativeFilePath(file.path);
+        auto item = new QListWidgetItem(tr("%1 (%2)").arg(name).arg(file.edits.size()), ui->fileList);
+        item->setCheckState(Qt::Checked);
+        if (file.inEditor)
+            item->setToolTip(tr("Open in the editor, changed in the document"));
+        replacements += file.edits.size();
+    }
+    ui->labelSummary->setText(tr("%1 replacements in %2 files").arg(replacements).arg(files.size()));
+    // Diff of one file at a time, built when the file is selected
+    connect(ui->fileList, &QListWidget::currentRowChanged, [this](int row) {
+        if (row < 0 || row >= this->files.size()) {
+            ui->diffView->clear();
+            return;
+        }
+        const auto& file = this->files.at(row);
+        QByteArray content;
+        if (file.inEditor) {
+            content = this->editorContents.value(file.path);
+        } else {
+            QFile f(file.path);
+            if (f.open(QFile::ReadOnly))
+                content = f.readAll();
+        }
+        ui->diffView->setPlainText(ReplaceInFiles::preview(content, file.edits));
+    });
+    connect(ui->buttonBox->button(QDialogButtonBox::Apply), &QPushButton::clicked, this, &QDialog::accept);
+    if (!files.isEmpty())
+        ui->fileList->setCurrentRow(0);
+}
+
+ReplacePreviewDialog::~ReplacePreviewDialog()
+{
+}
+
+ReplaceInFiles::FileEditsList ReplacePreviewDialog::selectedFiles() const
+{
+    ReplaceInFiles::FileEditsList selected;
+    for (int i = 0; i < files.size(); i++)
+        if (ui->fileList->item(i)->checkState() == Qt::Checked)
+            selected.append(files.at(i));
+    return selected;
+}
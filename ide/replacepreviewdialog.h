@@ -0,0 +1,52 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef REPLACEPREVIEWDIALOG_H
+#define REPLACEPREVIEWDIALOG_H
+
+#include "replaceinfiles.h"
+
+#include <QDialog>
+#include <QHash>
+
+#include <memory>
+
+namespace Ui {
+class ReplacePreviewDialog;
+}
+
+class ReplacePreviewDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit ReplacePreviewDialog(const ReplaceInFiles::FileEditsList& files,
+                                  const QHash<QString, QByteArray>& editorContents,
+                                  const QString& rootPath,
+                                  QWidget *parent = nullptr);
+    virtual ~ReplacePreviewDialog() override;
+
+    ReplaceInFiles::FileEditsList selectedFiles() const;
+
+private:
+    std::unique_ptr<Ui::ReplacePreviewDialog> ui;
+    ReplaceInFiles::FileEditsList files;
+    QHash<QString, QByteArray> editorContents;
+};
+
+#endif // REPLACEPREVIEWDIALOG_H
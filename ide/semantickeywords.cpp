@@ -0,0 +1,48 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "semantickeywords.h"
+
+#include <QStringList>
+
+SemanticKeywords::SemanticKeywords(QObject *parent) : QObject(parent)
+{
+}
+
+SemanticKeywords &SemanticKeywords::instance()
+{
+    static SemanticKeywords *ptr = nullptr;
+    if (!ptr)
+        ptr = new SemanticKeywords();
+    return *ptr;
+}
+
+SemanticKeywords::List SemanticKeywords::build(const QSet<QString> &words)
+{
+    auto sorted = words.toList();
+    sorted.sort();
+    return std::make_shared<const QByteArray>(sorted.join(' ').toUtf8());
+}
+
+void SemanticKeywords::publish(const SemanticKeywords::List &newList)
+{
+    if (list == newList || (list && newList && *list == *newList))
+        return;
+    list = newList;
+    emit changed();
+}
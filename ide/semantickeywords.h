@@ -0,0 +1,51 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SEMANTICKEYWORDS_H
+#define SEMANTICKEYWORDS_H
+
+#include <QObject>
+#include <QSet>
+
+#include <memory>
+
+class SemanticKeywords : public QObject
+{
+    Q_OBJECT
+
+private:
+    explicit SemanticKeywords(QObject *parent = nullptr);
+
+public:
+    // Space separated word list in the form Scintilla wants for a keyword set
+    using List = std::shared_ptr<const QByteArray>;
+
+    static SemanticKeywords &instance();
+    static List build(const QSet<QString>& words);
+
+    List current() const { return list; }
+    void publish(const List& newList);
+
+signals:
+    void changed();
+
+private:
+    List list;
+};
+
+#endif // SEMANTICKEYWORDS_H
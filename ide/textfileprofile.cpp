@@ -0,0 +1,267 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "textfileprofile.h"
+
+#include <QString>
+#include <QTextCodec>
+
+#include <array>
+#include <cstring>
+
+static const char UTF8_BOM[] = "\xEF\xBB\xBF";
+static const char UTF16LE_BOM[] = "\xFF\xFE";
+static const char UTF16BE_BOM[] = "\xFE\xFF";
+
+// Indentation guess from nppIndenture writed by Evan King
+// https://github.com/evan-king/nppIndenture
+// Licenced by GPL-3.0
+namespace npp_detectident {
+
+constexpr auto MIN_INDENT = 2; // minimum width of a single indentation
+constexpr auto MAX_INDENT = 8; // maximum width of a single indentation
+
+constexpr auto MIN_DEPTH = MIN_INDENT; // ignore lines below this indentation level
+constexpr auto MAX_DEPTH = 3*MAX_INDENT; // ignore lines beyond this indentation level
+
+// % of lines allowed to contradict indentation option without penalty
+constexpr auto GRACE_FREQUENCY = 1 / 50.0F;
+
+struct ParseResult {
+    int num_tab_lines = 0;
+    int num_space_lines = 0;
+
+    // indentation => count(lines of that exact indentation)
+    std::array<int, MAX_DEPTH+1> depth_counts = { { 0 } };
+};
+
+void decide(const ParseResult& result, int num_lines, TextFileProfile *profile)
+{
+    using Indent = TextFileProfile::Indent;
+    if (result.num_tab_lines + result.num_space_lines == 0)
+        profile->indent = Indent::Unknown;
+    else if (result.num_space_lines > (result.num_tab_lines * 4))
+        profile->indent = Indent::Spaces;
+    else if (result.num_tab_lines > (result.num_space_lines * 4))
+        profile->indent = Indent::Tabs;
+    if (profile->indent != Indent::Spaces)
+        return;
+
+    const float grace = float(num_lines) * GRACE_FREQUENCY;
+    // indent size => count(space-indented lines with incompatible indentation)
+    std::array<int, MAX_INDENT+1> margins = { { 0 } };
+    for (int i = MIN_DEPTH; i <= MAX_DEPTH; i++)
+        for (int k = MIN_INDENT; k <= MAX_INDENT; k++)
+            if (i % k != 0)
+                margins[size_t(k)] += result.depth_counts[size_t(i)];
+
+    // choose the last indent with the smallest margin (ties go to larger indent)
+    // Considers margins within grace of zero as =zero,
+    // so occasional typos don't force smaller indentation
+    int which = MIN_INDENT;
+    for (int i = MIN_INDENT; i <= MAX_INDENT; ++i) {
+        if (result.depth_counts[size_t(i)] == 0)
+            continue;
+        if (margins[size_t(i)] <= margins[size_t(which)] || margins[size_t(i)] < grace)
+            which = i;
+    }
+    profile->indentWidth = which;
+}
+
+}
+
+// No byte with the high bit set and no '\r' in the 8 bytes, the common case
+static inline bool isPlainWord(quint64 w)
+{
+    constexpr quint64 ONES = 0x0101010101010101ULL;
+    constexpr quint64 HIGH = 0x8080808080808080ULL;
+    constexpr quint64 CR = 0x0D0D0D0D0D0D0D0DULL;
+    auto x = w ^ CR;
+    auto hasCr = (x - ONES) & ~x & HIGH;
+    return ((w & HIGH) | hasCr) == 0;
+}
+
+// Length of the UTF-8 sequence at p, 0 when it is not well formed
+static int utf8SequenceLength(const uchar *p, const uchar *end)
+{
+    auto c = p[0];
+    int n;
+    uchar lo = 0x80;
+    uchar hi = 0xBF;
+    if (c >= 0xC2 && c <= 0xDF) {
+        n = 2;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        n = 3;
+        if (c == 0xE0)
+            lo = 0xA0;
+        else if (c == 0xED)
+            hi = 0x9F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        n = 4;
+        if (c == 0xF0)
+            lo = 0x90;
+        else if (c == 0xF4)
+            hi = 0x8F;
+    } else {
+        return 0;
+    }
+    if (end - p < n || p[1] < lo || p[1] > hi)
+        return 0;
+    for (int i = 2; i < n; i++)
+        if ((p[i] & 0xC0) != 0x80)
+            return 0;
+    return n;
+}
+
+// Returns false when the bytes are not valid UTF-8
+static bool scanUtf8(const char *data, int size, int tabWidth, TextFileProfile *profile)
+{
+    using namespace npp_detectident;
+    ParseResult indents;
+    int lf = 0;
+    int crlf = 0;
+    int cr = 0;
+    bool valid = true;
+    tabWidth = qMax(tabWidth, 1);
+    auto p = reinterpret_cast<const uchar*>(data);
+    auto end = p + size;
+    while (p < end) {
+        // libc memchr is vectorized, lines are found at memory speed
+        auto nl = static_cast<const uchar*>(std::memchr(p, '\n', size_t(end - p)));
+        auto lineEnd = nl? nl : end;
+        auto bodyEnd = (nl && lineEnd > p && lineEnd[-1] == '\r')? lineEnd - 1 : lineEnd;
+
+        auto q = p;
+        int depth = 0;
+        for (; q < bodyEnd && (*q == ' ' || *q == '\t'); q++)
+            depth = (*q == '\t')? (depth / tabWidth + 1) * tabWidth : depth + 1;
+        if (depth >= MIN_DEPTH && depth <= MAX_DEPTH) {
+            if (*p == '\t') {
+                indents.num_tab_lines++;
+            } else {
+                indents.num_space_lines++;
+                indents.depth_counts[size_t(depth)]++;
+            }
+        }
+
+        while (q < bodyEnd) {
+            if (bodyEnd - q >= 8) {
+                quint64 w;
+                std::memcpy(&w, q, sizeof(w));
+                if (isPlainWord(w)) {
+                    q += 8;
+                    continue;
+                }
+            }
+            auto c = *q;
+            if (c == '\r') {
+                cr++;
+                q++;
+            } else if (c < 0x80 || !valid) {
+                q++;
+            } else {
+                auto n = utf8SequenceLength(q, bodyEnd);
+                if (n == 0) {
+                    valid = false;
+                    n = 1;
+                }
+                q += n;
+            }
+        }
+
+        if (!nl)
+            break;
+        if (bodyEnd != lineEnd)
+            crlf++;
+        else
+            lf++;
+        p = nl + 1;
+    }
+
+    profile->lines = 1 + lf + crlf + cr;
+    auto most = qMax(lf, qMax(crlf, cr));
+    if (most > 0) {
+        profile->eol = (most == lf)? TextFileProfile::Eol::Unix :
+                       (most == crlf)? TextFileProfile::Eol::Windows : TextFileProfile::Eol::Mac;
+        profile->mixedEol = most != lf + crlf + cr;
+    }
+    decide(indents, profile->lines, profile);
+    return valid;
+}
+
+static QTextCodec *utf16Codec(TextFileProfile::Encoding encoding)
+{
+    return QTextCodec::codecForName(encoding == TextFileProfile::Encoding::Utf16LE? "UTF-16LE" : "UTF-16BE");
+}
+
+TextFileProfile TextFileProfile::scan(const char *data, int size, int tabWidth, QByteArray *utf8)
+{
+    TextFileProfile profile;
+    if (size >= 2 && (std::memcmp(data, UTF16LE_BOM, 2) == 0 || std::memcmp(data, UTF16BE_BOM, 2) == 0)) {
+        profile.encoding = (data[0] == UTF16LE_BOM[0])? Encoding::Utf16LE : Encoding::Utf16BE;
+        QTextCodec::ConverterState state(QTextCodec::IgnoreHeader);
+        *utf8 = utf16Codec(profile.encoding)->toUnicode(data + 2, size - 2, &state).toUtf8();
+        scanUtf8(utf8->constData(), utf8->size(), tabWidth, &profile);
+        return profile;
+    }
+    if (size >= 3 && std::memcmp(data, UTF8_BOM, 3) == 0)
+        profile.encoding = Encoding::Utf8Bom;
+    auto bom = profile.bomSize();
+    if (!scanUtf8(data + bom, size - bom, tabWidth, &profile)) {
+        // Line structure is ASCII either way, only the text needs converting
+        profile.encoding = Encoding::Latin1;
+        *utf8 = QString::fromLatin1(data, size).toUtf8();
+    }
+    return profile;
+}
+
+int TextFileProfile::bomSize() const
+{
+    switch (encoding) {
+    case Encoding::Utf8Bom: return 3;
+    case Encoding::Utf16LE:
+    case Encoding::Utf16BE: return 2;
+    default: return 0;
+    }
+}
+
+QByteArray TextFileProfile::encode(const QByteArray &utf8) const
+{
+    switch (encoding) {
+    case Encoding::Utf8:
+        return utf8;
+    case Encoding::Utf8Bom:
+        return QByteArray(UTF8_BOM) + utf8;
+    case Encoding::Utf16LE:
+    case Encoding::Utf16BE: {
+        QTextCodec::ConverterState state(QTextCodec::IgnoreHeader);
+        auto text = QString::fromUtf8(utf8);
+        auto bom = QByteArray(encoding == Encoding::Utf16LE? UTF16LE_BOM : UTF16BE_BOM, 2);
+        return bom + utf16Codec(encoding)->fromUnicode(text.constData(), text.size(), &state);
+    }
+    case Encoding::Latin1: {
+        auto text = QString::fromUtf8(utf8);
+        // Characters typed outside Latin-1 would be lost, such a file is written as UTF-8
+        for (const auto& c: text)
+            if (c.unicode() > 0xFF)
+                return utf8;
+        return text.toLatin1();
+    }
+    }
+    return utf8;
+}
@@ -0,0 +1,47 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef TEXTFILEPROFILE_H
+#define TEXTFILEPROFILE_H
+
+#include <QByteArray>
+
+// What a single pass over the raw bytes of a file tells about it
+class TextFileProfile
+{
+public:
+    enum class Encoding { Utf8, Utf8Bom, Utf16LE, Utf16BE, Latin1 };
+    enum class Eol { Unknown, Unix, Windows, Mac };
+    enum class Indent { Unknown, Spaces, Tabs };
+
+    Encoding encoding{ Encoding::Utf8 };
+    Eol eol{ Eol::Unknown };
+    bool mixedEol{ false };
+    Indent indent{ Indent::Unknown };
+    int indentWidth{ 0 };
+    int lines{ 1 };
+
+    // utf8 is filled only when the bytes need transcoding, otherwise they go to Scintilla
+    // as they are after skipping bomSize()
+    static TextFileProfile scan(const char *data, int size, int tabWidth, QByteArray *utf8);
+
+    int bomSize() const;
+    QByteArray encode(const QByteArray& utf8) const;
+};
+
+#endif // TEXTFILEPROFILE_H
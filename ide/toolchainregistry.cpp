@@ -0,0 +1,349 @@
+/*
+ * This file is part of Embedded-IDE
+ *
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "appconfig.h"
+#include "childprocess.h"
+#include "toolchainregistry.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <QtConcurrent>
+
+#include <QtDebug>
+
+static const QString CACHE_FILE = "toolchains.json";
+
+static const QRegularExpression COMPILER_NAME_RE(R"(^(?:[\w.]+-)*(?:gcc|g\+\+|cc|c\+\+|clang|clang\+\+)(?:-[\d.]+)?(?:\.exe)?$)");
+static const QRegularExpression VERSION_RE(R"(^(?:.*\s)?(?:gcc|clang) version (\S+))", QRegularExpression::MultilineOption);
+static const QRegularExpression TARGET_RE(R"(^Target: (\S+))", QRegularExpression::MultilineOption);
+static const QRegularExpression DEFINE_RE(R"(^#define (\S+)(?: (.*?))?\r?$)", QRegularExpression::MultilineOption);
+
+// Only these options change the builtin search paths or predefined macros
+static const QStringList TARGET_OPTIONS = {
+    "-m", "-std=", "-ansi", "-O", "--specs=", "-specs=", "--sysroot=", "--target=", "-nostdinc",
+};
+static const QStringList TARGET_OPTIONS_WITH_VALUE = { "-target", "-isysroot" };
+
+struct BinaryRecord {
+    qint64 size{ -1 };
+    qint64 modified{ -1 };
+    QString hash;
+
+    bool matches(const QFileInfo& info) const {
+        return !hash.isEmpty() && size == info.size() && modified == info.lastModified().toMSecsSinceEpoch();
+    }
+};
+
+static BinaryRecord hashBinary(const QString& path)
+{
+    QFileInfo info(path);
+    BinaryRecord record{ info.size(), info.lastModified().toMSecsSinceEpoch(), QString() };
+    QFile f(path);
+    if (f.open(QFile::ReadOnly)) {
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        if (hash.addData(&f))
+            record.hash = hash.result().toHex();
+    }
+    return record;
+}
+
+static QHash<QString, QString> scanCompilers(const QStringList& dirs)
+{
+    QHash<QString, QString> found;
+    for (const auto& dir: dirs) {
+        for (const auto& info: QDir(dir).entryInfoList(QDir::Files | QDir::Executable)) {
+            // First match wins, same as the PATH lookup
+            if (COMPILER_NAME_RE.match(info.fileName()).hasMatch() && !found.contains(info.fileName()))
+                found.insert(info.fileName(), info.absoluteFilePath());
+        }
+    }
+    return found;
+}
+
+static QString toolchainKey(const QString& binaryHash, const QStringList& flags)
+{
+    auto text = (QStringList{ binaryHash } + flags).join('\n');
+    return QCryptographicHash::hash(text.toUtf8(), QCryptographicHash::Sha1).toHex();
+}
+
+static QStringList jsonToList(const QJsonValue& v)
+{
+    QStringList list;
+    for (const auto e: v.toArray())
+        list.append(e.toString());
+    return list;
+}
+
+static void parseSearchList(const QString& text, QStringList *incs)
+{
+    bool onIncludes = false;
+    for (const auto& line: text.split('\n')) {
+        if (!onIncludes) {
+            if (line.startsWith("#include "))
+                onIncludes = true;
+        } else if (line.startsWith("End of search list")) {
+            onIncludes = false;
+        } else if (!line.startsWith("#include ")) {
+            auto ipath = QDir::cleanPath(line.trimmed().remove(" (framework directory)"));
+            if (!ipath.isEmpty() && !incs->contains(ipath))
+                incs->append(ipath);
+        }
+    }
+}
+
+class ToolchainRegistry::Priv_t
+{
+public:
+    QHash<QString, QString> discovered;
+    QHash<QString, BinaryRecord> binaries;
+    QHash<QString, Toolchain> toolchains;
+    QHash<QString, QString> resolved;
+    QSet<QString> pending;
+
+    QString cacheFile() const {
+        return QDir(AppConfig::instance().cachePath()).absoluteFilePath(CACHE_FILE);
+    }
+
+    QString resolve(const QString& name, const QString& workingDir) {
+        if (name.isEmpty())
+            return QString();
+        auto key = QDir(workingDir).absoluteFilePath(name);
+        auto it = resolved.find(key);
+        if (it == resolved.end()) {
+            QString path;
+            if (name.contains('/') || name.contains('\\'))
+                path = key;
+            else if (discovered.contains(name))
+                path = discovered.value(name);
+            else
+                path = QStandardPaths::findExecutable(name);
+            it = resolved.insert(key, path.isEmpty()? QString() : QFileInfo(path).canonicalFilePath());
+        }
+        return it.value();
+    }
+
+    QString freshHash(const QString& path) const {
+        auto it = binaries.find(path);
+        if (it != binaries.end() && it->matches(QFileInfo(path)))
+            return it->hash;
+        return QString();
+    }
+
+    void load() {
+        auto o = QJsonDocument::fromJson(AppConfig::readEntireTextFile(cacheFile())).object();
+        auto bins = o.value("binaries").toObject();
+        for (auto it = bins.begin(); it != bins.end(); ++it) {
+            auto b = it.value().toObject();
+            binaries.insert(it.key(), BinaryRecord{
+                                static_cast<qint64>(b.value("size").toDouble(-1)),
+                                static_cast<qint64>(b.value("modified").toDouble(-1)),
+                                b.value("hash").toString() });
+        }
+        auto tcs = o.value("toolchains").toObject();
+        for (auto it = tcs.begin(); it != tcs.end(); ++it) {
+            auto t = it.value().toObject();
+            toolchains.insert(it.key(), Toolchain{
+                                  t.value("compiler").toString(),
+                                  jsonToList(t.value("flags")),
+                                  t.value("version").toString(),
+                                  t.value("target").toString(),
+                                  jsonToList(t.value("includes")),
+                                  jsonToList(t.value("macros")) });
+        }
+    }
+
+    void save() const {
+        QJsonObject bins;
+        for (auto it = binaries.begin(); it != binaries.end(); ++it)
+            bins.insert(it.key(), QJsonObject{
+                            { "size", double(it->size) },
+                            { "modified", double(it->modified) },
+                            { "hash", it->hash },
+                        });
+        QJsonObject tcs;
+        for (auto it = toolchains.begin(); it != toolchains.end(); ++it)
+            tcs.insert(it.key(), QJsonObject{
+                           { "compiler", it->compiler },
+                           { "flags", QJsonArray::fromStringList(it->flags) },
+                           { "version", it->version },
+                           { "target", it->target },
+                           { "includes", QJsonArray::fromStringList(it->includePaths) },
+                           { "macros", QJsonArray::fromStringList(it->macros) },
+                       });
+        QSaveFile f(cacheFile());
+        if (f.open(QFile::WriteOnly)) {
+            f.write(QJsonDocument(QJsonObject{ { "binaries", bins }, { "toolchains", tcs } }).toJson(QJsonDocument::Compact));
+            f.commit();
+        }
+    }
+};
+
+ToolchainRegistry::ToolchainRegistry(QObject *parent) :
+    QObject(parent),
+    priv(std::make_unique<Priv_t>())
+{
+    priv->load();
+}
+
+ToolchainRegistry::~ToolchainRegistry()
+{
+}
+
+QStringList ToolchainRegistry::compilers() const
+{
+    auto list = priv->discovered.values();
+    list.sort();
+    return list;
+}
+
+ToolchainRegistry::Toolchain ToolchainRegistry::find(const QStringList &command, bool cxx, const QString &workingDir) const
+{
+    auto path = priv->resolve(command.value(0), workingDir);
+    if (path.isEmpty())
+        return {};
+    auto hash = priv->freshHash(path);
+    if (hash.isEmpty())
+        return {};
+    return priv->toolchains.value(toolchainKey(hash, probeFlags(command, cxx)));
+}
+
+QStringList ToolchainRegistry::probeFlags(const QStringList &command, bool cxx)
+{
+    QStringList flags;
+    for (int i = 1; i < command.size(); i++) {
+        const auto& arg = command.at(i);
+        if (TARGET_OPTIONS_WITH_VALUE.contains(arg) && i + 1 < command.size()) {
+            flags << arg << command.at(++i);
+        } else {
+            for (const auto& opt: TARGET_OPTIONS) {
+                if (arg.startsWith(opt)) {
+                    flags << arg;
+                    break;
+                }
+            }
+        }
+    }
+    flags << "-x" << (cxx? "c++" : "c");
+    return flags;
+}
+
+QString ToolchainRegistry::commandKey(const QStringList &command, bool cxx)
+{
+    return (QStringList{ command.value(0) } + probeFlags(command, cxx)).join('\n');
+}
+
+void ToolchainRegistry::discover()
+{
+    auto dirs = AppConfig::instance().additionalPaths();
+    dirs += QProcessEnvironment::systemEnvironment().value("PATH").split(QDir::listSeparator(), QString::SkipEmptyParts);
+    dirs.removeDuplicates();
+    auto watcher = new QFutureWatcher<QHash<QString, QString>>(this);
+    connect(watcher, &QFutureWatcher<QHash<QString, QString>>::finished, [this, watcher]() {
+        priv->discovered = watcher->result();
+        priv->resolved.clear();
+        watcher->deleteLater();
+        // The bare compiler is cached once, project flags are probed on demand
+        for (auto it = priv->discovered.begin(); it != priv->discovered.end(); ++it) {
+            probe({ it.value() }, it.key().contains("++"));
+        }
+        emit compilersDiscovered(compilers());
+    });
+    watcher->setFuture(QtConcurrent::run(scanCompilers, dirs));
+}
+
+void ToolchainRegistry::probe(const QStringList &command, bool cxx, const QString &workingDir)
+{
+    auto path = priv->resolve(command.value(0), workingDir);
+    if (path.isEmpty())
+        return;
+    auto key = commandKey(command, cxx);
+    if (priv->pending.contains(key))
+        return;
+    auto flags = probeFlags(command, cxx);
+    auto hash = priv->freshHash(path);
+    if (!hash.isEmpty() && priv->toolchains.contains(toolchainKey(hash, flags)))
+        return;
+    priv->pending.insert(key);
+
+    auto runCompiler = [this, path, flags, key, workingDir](const QString& id) {
+        auto& p = ChildProcess::create(this)
+                .changeCWD(workingDir.isEmpty()? QDir::tempPath() : workingDir)
+                .setenv({ { "LC_ALL", "C" } })
+                .makeDeleteLater()
+                .onStarted([](QProcess *cc) {
+            cc->closeWriteChannel();
+        }).onFinished([this, path, flags, key, id](QProcess *cc, int exitCode) {
+            priv->pending.remove(key);
+            QString macros = cc->readAllStandardOutput();
+            QString info = cc->readAllStandardError();
+            if (exitCode != 0) {
+                qDebug() << "toolchain probe failed:" << path << flags << info;
+                return;
+            }
+            Toolchain tc{ path, flags, VERSION_RE.match(info).captured(1), TARGET_RE.match(info).captured(1), {}, {} };
+            parseSearchList(info, &tc.includePaths);
+            auto it = DEFINE_RE.globalMatch(macros);
+            while (it.hasNext()) {
+                auto m = it.next();
+                tc.macros.append(m.captured(2).isEmpty()? m.captured(1) : QString("%1=%2").arg(m.captured(1), m.captured(2)));
+            }
+            priv->toolchains.insert(id, tc);
+            priv->save();
+            emit toolchainReady(key);
+        }).onError([this, key](QProcess *cc, QProcess::ProcessError err) {
+            if (err == QProcess::FailedToStart)
+                priv->pending.remove(key);
+            qDebug() << "toolchain probe error:" << cc->program() << cc->errorString();
+        });
+        p.start(path, flags + QStringList{ "-dM", "-E", "-v", "-" });
+    };
+
+    if (!hash.isEmpty()) {
+        runCompiler(toolchainKey(hash, flags));
+        return;
+    }
+    auto watcher = new QFutureWatcher<BinaryRecord>(this);
+    connect(watcher, &QFutureWatcher<BinaryRecord>::finished, [this, watcher, path, flags, key, runCompiler]() {
+        auto record = watcher->result();
+        watcher->deleteLater();
+        if (record.hash.isEmpty()) {
+            priv->pending.remove(key);
+            return;
+        }
+        priv->binaries.insert(path, record);
+        auto id = toolchainKey(record.hash, flags);
+        if (priv->toolchains.contains(id)) {
+            // Same binary seen under another path or after a touch, nothing to run
+            priv->pending.remove(key);
+            priv->save();
+            emit toolchainReady(key);
+        } else {
+            runCompiler(id);
+        }
+    });
+    watcher->setFuture(QtConcurrent::run(hashBinary, path));
+}
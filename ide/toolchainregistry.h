@@ -0,0 +1,65 @@
+/*
+ * This file is part of Embedded-IDE
+ *
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef TOOLCHAINREGISTRY_H
+#define TOOLCHAINREGISTRY_H
+
+#include <QObject>
+#include <QStringList>
+
+#include <memory>
+
+class ToolchainRegistry : public QObject
+{
+    Q_OBJECT
+public:
+    struct Toolchain {
+        QString compiler;
+        QStringList flags;
+        QString version;
+        QString target;
+        QStringList includePaths;
+        QStringList macros;
+
+        bool isEmpty() const { return compiler.isEmpty(); }
+    };
+
+    explicit ToolchainRegistry(QObject *parent = nullptr);
+    virtual ~ToolchainRegistry() override;
+
+    QStringList compilers() const;
+    // Relative compilers resolve against workingDir, as when probed
+    Toolchain find(const QStringList& command, bool cxx, const QString& workingDir = QString()) const;
+
+    static QStringList probeFlags(const QStringList& command, bool cxx);
+    static QString commandKey(const QStringList& command, bool cxx);
+
+signals:
+    void compilersDiscovered(const QStringList& compilers);
+    void toolchainReady(const QString& commandKey);
+
+public slots:
+    void discover();
+    void probe(const QStringList& command, bool cxx, const QString& workingDir = QString());
+
+private:
+    class Priv_t;
+    std::unique_ptr<Priv_t> priv;
+};
+
+#endif // TOOLCHAINREGISTRY_H
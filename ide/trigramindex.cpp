@@ -0,0 +1,678 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "appconfig.h"
+#include "trigramindex.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QFutureWatcher>
+#include <QPointer>
+#include <QReadWriteLock>
+#include <QRegularExpression>
+#include <QSaveFile>
+#include <QTimer>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+
+#include <QtDebug>
+
+static constexpr quint32 INDEX_MAGIC = 0x54524731; // "TRG1"
+static constexpr qint32 INDEX_VERSION = 1;
+static constexpr qint64 MAX_INDEXED_SIZE = 16 * 1024 * 1024;
+static constexpr int BINARY_PROBE_SIZE = 8000;
+static constexpr int MAX_WATCHED_DIRECTORIES = 4096;
+static constexpr int REFRESH_DELAY = 1000;
+static constexpr int SAVE_DELAY = 10000;
+
+static const QRegularExpression EXTENDED_FLAG_RE(R"(\(\?[a-zA-Z]*x)");
+static const QRegularExpression COUNTED_QUANTIFIER_RE(R"(^\{\d*,?\d*\})");
+
+static inline uchar fold(uchar c)
+{
+    return (c >= 'A' && c <= 'Z')? uchar(c + ('a' - 'A')) : c;
+}
+
+static inline bool isLineBreak(uchar c)
+{
+    return c == '\n' || c == '\r';
+}
+
+static void appendVarint(QByteArray& out, quint32 v)
+{
+    while (v >= 0x80) {
+        out.append(char((v & 0x7F) | 0x80));
+        v >>= 7;
+    }
+    out.append(char(v));
+}
+
+static quint32 readVarint(const char *&p)
+{
+    quint32 v = 0;
+    int shift = 0;
+    quint8 b;
+    do {
+        b = quint8(*p++);
+        v |= quint32(b & 0x7F) << shift;
+        shift += 7;
+    } while (b & 0x80);
+    return v;
+}
+
+static qint64 modifiedTime(const QFileInfo& info)
+{
+    return info.lastModified().toMSecsSinceEpoch();
+}
+
+struct FileEntry {
+    QString path;
+    qint64 size;
+    qint64 modified;
+    bool indexed; // Too big to index, kept so it is always scanned
+    bool live;
+};
+
+struct Posting {
+    QByteArray ids; // Ascending file ids as varint deltas
+    int last{ 0 };
+};
+
+struct ScannedFile {
+    QString path;
+    qint64 size{ -1 };
+    qint64 modified{ -1 };
+    bool indexed{ false };
+    QVector<quint32> trigrams;
+};
+
+struct SweepResult {
+    QStringList stale;
+    QStringList removed;
+    QStringList directories;
+};
+
+// Files only get appended, a rescanned file takes a new id and the old one is left
+// dead until compacted() builds a fresh copy, so ids seen by a Lookup never move
+struct TrigramIndex::Data {
+    mutable QReadWriteLock lock;
+    QString root;
+    QHash<QString, int> ids;
+    QVector<FileEntry> files;
+    QHash<quint32, Posting> postings;
+    int dead{ 0 };
+
+    void remove(const QString& path) {
+        auto it = ids.find(path);
+        if (it == ids.end())
+            return;
+        files[it.value()].live = false;
+        dead++;
+        ids.erase(it);
+    }
+
+    void insert(const ScannedFile& file) {
+        remove(file.path);
+        if (file.modified == -1)
+            return;
+        int id = files.size();
+        files.append(FileEntry{ file.path, file.size, file.modified, file.indexed, true });
+        ids.insert(file.path, id);
+        for (auto t: file.trigrams) {
+            auto& p = postings[t];
+            appendVarint(p.ids, quint32(id - p.last));
+            p.last = id;
+        }
+    }
+
+    static QVector<int> decode(const Posting& posting) {
+        QVector<int> list;
+        const char *p = posting.ids.constData();
+        const char *end = p + posting.ids.size();
+        int id = 0;
+        while (p < end) {
+            id += int(readVarint(p));
+            list.append(id);
+        }
+        return list;
+    }
+
+    std::shared_ptr<Data> compacted() const {
+        auto out = std::make_shared<Data>();
+        out->root = root;
+        QVector<int> remap(files.size(), -1);
+        for (int i = 0; i < files.size(); i++) {
+            if (files.at(i).live) {
+                remap[i] = out->files.size();
+                out->ids.insert(files.at(i).path, out->files.size());
+                out->files.append(files.at(i));
+            }
+        }
+        for (auto it = postings.begin(); it != postings.end(); ++it) {
+            Posting p;
+            for (auto id: decode(it.value())) {
+                if (remap.at(id) >= 0) {
+                    appendVarint(p.ids, quint32(remap.at(id) - p.last));
+                    p.last = remap.at(id);
+                }
+            }
+            if (!p.ids.isEmpty())
+                out->postings.insert(it.key(), p);
+        }
+        return out;
+    }
+
+    bool save(const QString& fileName) const {
+        QSaveFile f(fileName);
+        if (!f.open(QFile::WriteOnly))
+            return false;
+        QDataStream s(&f);
+        s.setVersion(QDataStream::Qt_5_6);
+        s << INDEX_MAGIC << INDEX_VERSION << root << qint32(files.size());
+        for (const auto& e: files)
+            s << e.path << e.size << e.modified << e.indexed;
+        s << qint32(postings.size());
+        for (auto it = postings.begin(); it != postings.end(); ++it)
+            s << it.key() << it->ids << qint32(it->last);
+        return s.status() == QDataStream::Ok && f.commit();
+    }
+
+    static std::shared_ptr<Data> load(const QString& fileName, const QString& root) {
+        QFile f(fileName);
+        if (!f.open(QFile::ReadOnly))
+            return nullptr;
+        QDataStream s(&f);
+        s.setVersion(QDataStream::Qt_5_6);
+        quint32 magic;
+        qint32 version;
+        QString savedRoot;
+        qint32 count;
+        s >> magic >> version >> savedRoot >> count;
+        if (magic != INDEX_MAGIC || version != INDEX_VERSION || savedRoot != root || count < 0)
+            return nullptr;
+        auto data = std::make_shared<Data>();
+        data->root = root;
+        data->files.reserve(count);
+        for (int i = 0; i < count && s.status() == QDataStream::Ok; i++) {
+            FileEntry e{ QString(), -1, -1, false, true };
+            s >> e.path >> e.size >> e.modified >> e.indexed;
+            data->ids.insert(e.path, data->files.size());
+            data->files.append(e);
+        }
+        s >> count;
+        data->postings.reserve(count);
+        for (int i = 0; i < count && s.status() == QDataStream::Ok; i++) {
+            quint32 key;
+            Posting p;
+            qint32 last;
+            s >> key >> p.ids >> last;
+            p.last = last;
+            data->postings.insert(key, p);
+        }
+        return s.status() == QDataStream::Ok? data : nullptr;
+    }
+};
+
+static ScannedFile scanFile(const QString& path)
+{
+    ScannedFile scanned;
+    scanned.path = path;
+    QFileInfo info(path);
+    QFile f(path);
+    if (!f.open(QFile::ReadOnly))
+        return scanned;
+    scanned.size = info.size();
+    scanned.modified = modifiedTime(info);
+    if (scanned.size > MAX_INDEXED_SIZE)
+        return scanned;
+    scanned.indexed = true;
+    const int n = int(f.size());
+    if (n == 0)
+        return scanned;
+    QByteArray buffer;
+    auto data = reinterpret_cast<const char*>(f.map(0, n));
+    if (!data) {
+        buffer = f.readAll();
+        data = buffer.constData();
+    }
+    // Binary files never match a search, indexed without trigrams
+    if (!std::memchr(data, 0, size_t(qMin(n, BINARY_PROBE_SIZE))))
+        scanned.trigrams = TrigramIndex::fileTrigrams(QByteArray::fromRawData(data, n));
+    return scanned;
+}
+
+static SweepResult sweep(const std::shared_ptr<TrigramIndex::Data>& data, const QString& root)
+{
+    struct Stamp {
+        QString path;
+        qint64 size;
+        qint64 modified;
+    };
+    SweepResult result;
+    QVector<Stamp> stamps;
+    result.directories.append(root);
+    QDirIterator it(root, QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        auto path = it.next();
+        auto info = it.fileInfo();
+        if (info.isDir())
+            result.directories.append(path);
+        else
+            stamps.append(Stamp{ path, info.size(), modifiedTime(info) });
+    }
+    QReadLocker locker(&data->lock);
+    QSet<QString> seen;
+    seen.reserve(stamps.size());
+    for (const auto& stamp: stamps) {
+        seen.insert(stamp.path);
+        auto id = data->ids.value(stamp.path, -1);
+        if (id == -1 || data->files.at(id).size != stamp.size || data->files.at(id).modified != stamp.modified)
+            result.stale.append(stamp.path);
+    }
+    for (auto i = data->ids.begin(); i != data->ids.end(); ++i)
+        if (!seen.contains(i.key()))
+            result.removed.append(i.key());
+    return result;
+}
+
+class TrigramIndex::Priv_t
+{
+public:
+    std::shared_ptr<Data> data{ std::make_shared<Data>() };
+    QString cacheFile;
+    QPointer<QFutureWatcher<std::shared_ptr<Data>>> loadWatcher;
+    QPointer<QFutureWatcher<SweepResult>> sweepWatcher;
+    QPointer<QFutureWatcher<ScannedFile>> scanWatcher;
+    QFileSystemWatcher *fsWatcher{ nullptr };
+    QTimer *refreshTimer{ nullptr };
+    QTimer *saveTimer{ nullptr };
+    bool refreshPending{ false };
+
+    bool isBusy() const { return loadWatcher || sweepWatcher || scanWatcher; }
+
+    void compact() {
+        // The old data may go away with the assignment, release its lock first
+        auto old = data;
+        std::shared_ptr<Data> fresh;
+        {
+            QReadLocker locker(&old->lock);
+            fresh = old->compacted();
+        }
+        data = fresh;
+    }
+
+    void compactIfNeeded() {
+        if (data->dead > 0 && data->dead * 4 > data->files.size())
+            compact();
+    }
+
+    void save() {
+        if (data->root.isEmpty())
+            return;
+        if (data->dead > 0)
+            compact();
+        auto snapshot = data;
+        auto fileName = cacheFile;
+        QtConcurrent::run([snapshot, fileName]() {
+            QReadLocker locker(&snapshot->lock);
+            if (!snapshot->save(fileName))
+                qDebug() << "cannot save text index" << fileName;
+        });
+    }
+
+    void cancelAll() {
+        for (auto w: std::initializer_list<QFutureWatcherBase*>{ loadWatcher, sweepWatcher, scanWatcher })
+            if (w)
+                w->cancel();
+        loadWatcher.clear();
+        sweepWatcher.clear();
+        scanWatcher.clear();
+        refreshPending = false;
+    }
+};
+
+bool TrigramIndex::Lookup::narrow(const QString &text, bool isRegex, bool caseSensitive)
+{
+    narrowed = false;
+    candidates.clear();
+    if (!data)
+        return false;
+    auto trigrams = queryTrigrams(text, isRegex, caseSensitive);
+    if (trigrams.isEmpty())
+        return false;
+    QReadLocker locker(&data->lock);
+    // Rarest first keeps the intersection small from the start
+    std::sort(trigrams.begin(), trigrams.end(), [this](quint32 a, quint32 b) {
+        return data->postings.value(a).ids.size() < data->postings.value(b).ids.size();
+    });
+    QVector<int> result;
+    for (int i = 0; i < trigrams.size(); i++) {
+        auto it = data->postings.find(trigrams.at(i));
+        if (it == data->postings.end()) {
+            result.clear();
+            break;
+        }
+        auto ids = Data::decode(it.value());
+        if (i == 0) {
+            result = ids;
+        } else {
+            QVector<int> both;
+            std::set_intersection(result.begin(), result.end(), ids.begin(), ids.end(), std::back_inserter(both));
+            result.swap(both);
+        }
+        if (result.isEmpty())
+            break;
+    }
+    candidates.reserve(result.size());
+    for (auto id: result)
+        candidates.insert(id);
+    limit = data->files.size();
+    narrowed = true;
+    return true;
+}
+
+bool TrigramIndex::Lookup::mayMatch(const QFileInfo &info) const
+{
+    if (!narrowed)
+        return true;
+    QReadLocker locker(&data->lock);
+    auto id = data->ids.value(QDir::cleanPath(info.absoluteFilePath()), -1);
+    // Unknown, indexed after narrow() or changed on disk since indexed
+    if (id == -1 || id >= limit)
+        return true;
+    const auto& entry = data->files.at(id);
+    if (!entry.indexed || entry.size != info.size() || entry.modified != modifiedTime(info))
+        return true;
+    return candidates.contains(id);
+}
+
+TrigramIndex::TrigramIndex(QObject *parent) :
+    QObject(parent),
+    priv(std::make_unique<Priv_t>())
+{
+    priv->fsWatcher = new QFileSystemWatcher(this);
+    priv->refreshTimer = new QTimer(this);
+    priv->refreshTimer->setSingleShot(true);
+    priv->refreshTimer->setInterval(REFRESH_DELAY);
+    priv->saveTimer = new QTimer(this);
+    priv->saveTimer->setSingleShot(true);
+    priv->saveTimer->setInterval(SAVE_DELAY);
+    connect(priv->fsWatcher, &QFileSystemWatcher::directoryChanged, priv->refreshTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+    connect(priv->refreshTimer, &QTimer::timeout, this, &TrigramIndex::refresh);
+    connect(priv->saveTimer, &QTimer::timeout, [this]() { priv->save(); });
+}
+
+TrigramIndex::~TrigramIndex()
+{
+    priv->cancelAll();
+    if (priv->saveTimer->isActive())
+        priv->save();
+}
+
+QString TrigramIndex::root() const
+{
+    return priv->data->root;
+}
+
+TrigramIndex::Lookup TrigramIndex::lookup() const
+{
+    Lookup l;
+    if (!priv->data->root.isEmpty())
+        l.data = priv->data;
+    return l;
+}
+
+QVector<quint32> TrigramIndex::fileTrigrams(const QByteArray &text)
+{
+    QVector<quint32> list;
+    const auto s = reinterpret_cast<const uchar*>(text.constData());
+    const int n = text.size();
+    list.reserve(qMin(n, 1 << 16));
+    quint32 t = 0;
+    int lastBreak = -1;
+    for (int i = 0; i < n; i++) {
+        if (isLineBreak(s[i]))
+            lastBreak = i;
+        t = ((t << 8) | fold(s[i])) & 0xFFFFFF;
+        if (i - lastBreak >= 3)
+            list.append(t);
+    }
+    std::sort(list.begin(), list.end());
+    list.erase(std::unique(list.begin(), list.end()), list.end());
+    return list;
+}
+
+static void appendRunTrigrams(QVector<quint32>& out, const QString& run, bool caseSensitive)
+{
+    auto bytes = run.toUtf8();
+    const auto s = reinterpret_cast<const uchar*>(bytes.constData());
+    for (int i = 0; i + 2 < bytes.size(); i++) {
+        if (isLineBreak(s[i]) || isLineBreak(s[i + 1]) || isLineBreak(s[i + 2]))
+            continue;
+        // Only ASCII is folded, other letters may match in a different case
+        if (!caseSensitive && (s[i] >= 0x80 || s[i + 1] >= 0x80 || s[i + 2] >= 0x80))
+            continue;
+        out.append(quint32(fold(s[i])) << 16 | quint32(fold(s[i + 1])) << 8 | fold(s[i + 2]));
+    }
+}
+
+// Literal runs every match must contain. Anything that could make a run optional
+// cuts it, alternation at the top level gives up
+static QStringList requiredRuns(const QString& pattern)
+{
+    static const QString BAIL_ESCAPES = "xocpPNkgQEu0123456789";
+    QStringList runs;
+    QString run;
+    int depth = 0;
+    auto endRun = [&]() {
+        if (depth == 0 && !run.isEmpty())
+            runs.append(run);
+        run.clear();
+    };
+    if (pattern.contains(EXTENDED_FLAG_RE))
+        return {};
+    for (int i = 0; i < pattern.size(); i++) {
+        auto c = pattern.at(i);
+        if (c == '\\' && i + 1 < pattern.size()) {
+            auto e = pattern.at(++i);
+            if (BAIL_ESCAPES.contains(e))
+                return {};
+            if (e.isLetterOrNumber())
+                endRun();
+            else
+                run.append(e);
+            continue;
+        }
+        switch (c.unicode()) {
+        case '(':
+            endRun();
+            depth++;
+            break;
+        case ')':
+            endRun();
+            depth = qMax(0, depth - 1);
+            break;
+        case '|':
+            if (depth == 0)
+                return {};
+            endRun();
+            break;
+        case '[':
+            endRun();
+            for (i += (i + 1 < pattern.size() && pattern.at(i + 1) == '^')? 2 : 1;
+                 i < pattern.size() && pattern.at(i) != ']'; i++)
+                if (pattern.at(i) == '\\')
+                    i++;
+            break;
+        case '?':
+        case '*':
+            run.chop(1);
+            endRun();
+            break;
+        case '{':
+            if (COUNTED_QUANTIFIER_RE.match(pattern.midRef(i)).hasMatch()) {
+                run.chop(1);
+                endRun();
+                i = pattern.indexOf('}', i);
+            } else {
+                run.append(c);
+            }
+            break;
+        case '+':
+        case '.':
+        case '^':
+        case '$':
+            endRun();
+            break;
+        default:
+            run.append(c);
+        }
+    }
+    endRun();
+    return runs;
+}
+
+QVector<quint32> TrigramIndex::queryTrigrams(const QString &text, bool isRegex, bool caseSensitive)
+{
+    QVector<quint32> list;
+    for (const auto& run: isRegex? requiredRuns(text) : QStringList{ text })
+        appendRunTrigrams(list, run, caseSensitive);
+    std::sort(list.begin(), list.end());
+    list.erase(std::unique(list.begin(), list.end()), list.end());
+    return list;
+}
+
+void TrigramIndex::setRoot(const QString &path)
+{
+    auto root = path.isEmpty()? QString() : QDir::cleanPath(QFileInfo(path).absoluteFilePath());
+    if (root == priv->data->root)
+        return;
+    if (priv->saveTimer->isActive()) {
+        priv->saveTimer->stop();
+        priv->save();
+    }
+    priv->cancelAll();
+    priv->refreshTimer->stop();
+    if (!priv->fsWatcher->directories().isEmpty())
+        priv->fsWatcher->removePaths(priv->fsWatcher->directories());
+    priv->data = std::make_shared<Data>();
+    priv->data->root = root;
+    if (root.isEmpty()) {
+        emit updated(0);
+        return;
+    }
+    auto id = QCryptographicHash::hash(root.toUtf8(), QCryptographicHash::Sha1).toHex();
+    priv->cacheFile = QDir(AppConfig::instance().cachePath()).absoluteFilePath(QString("%1.trigrams").arg(QString(id)));
+
+    auto watcher = new QFutureWatcher<std::shared_ptr<Data>>(this);
+    priv->loadWatcher = watcher;
+    connect(watcher, &QFutureWatcher<std::shared_ptr<Data>>::finished, [this, watcher]() {
+        watcher->deleteLater();
+        if (priv->loadWatcher != watcher)
+            return;
+        priv->loadWatcher.clear();
+        auto loaded = watcher->result();
+        if (loaded) {
+            qDebug() << "text index loaded with" << loaded->files.size() << "files";
+            priv->data = loaded;
+            emit updated(loaded->files.size());
+        }
+        refresh();
+    });
+    auto fileName = priv->cacheFile;
+    watcher->setFuture(QtConcurrent::run([fileName, root]() { return Data::load(fileName, root); }));
+}
+
+void TrigramIndex::refresh()
+{
+    if (priv->data->root.isEmpty())
+        return;
+    if (priv->isBusy()) {
+        priv->refreshPending = true;
+        return;
+    }
+    priv->refreshPending = false;
+    auto watcher = new QFutureWatcher<SweepResult>(this);
+    priv->sweepWatcher = watcher;
+    connect(watcher, &QFutureWatcher<SweepResult>::finished, [this, watcher]() {
+        watcher->deleteLater();
+        if (priv->sweepWatcher != watcher)
+            return;
+        priv->sweepWatcher.clear();
+        auto result = watcher->result();
+
+        auto watched = priv->fsWatcher->directories().toSet();
+        QStringList missing;
+        for (const auto& dir: result.directories)
+            if (!watched.contains(dir) && watched.size() + missing.size() < MAX_WATCHED_DIRECTORIES)
+                missing.append(dir);
+        if (!missing.isEmpty())
+            priv->fsWatcher->addPaths(missing);
+
+        if (!result.removed.isEmpty()) {
+            QWriteLocker locker(&priv->data->lock);
+            for (const auto& path: result.removed)
+                priv->data->remove(path);
+        }
+        if (result.stale.isEmpty()) {
+            if (!result.removed.isEmpty()) {
+                priv->compactIfNeeded();
+                priv->saveTimer->start();
+                emit updated(priv->data->ids.size());
+            }
+            if (priv->refreshPending)
+                refresh();
+            return;
+        }
+        auto scan = new QFutureWatcher<ScannedFile>(this);
+        priv->scanWatcher = scan;
+        connect(scan, &QFutureWatcher<ScannedFile>::resultsReadyAt, [this, scan](int begin, int end) {
+            if (priv->scanWatcher != scan)
+                return;
+            QWriteLocker locker(&priv->data->lock);
+            for (int i = begin; i < end; i++)
+                priv->data->insert(scan->resultAt(i));
+        });
+        connect(scan, &QFutureWatcher<ScannedFile>::finished, [this, scan]() {
+            scan->deleteLater();
+            if (priv->scanWatcher != scan)
+                return;
+            priv->scanWatcher.clear();
+            priv->compactIfNeeded();
+            qDebug() << "text index updated," << priv->data->ids.size() << "files" << priv->data->postings.size() << "trigrams";
+            priv->saveTimer->start();
+            emit updated(priv->data->ids.size());
+            if (priv->refreshPending)
+                refresh();
+        });
+        scan->setFuture(QtConcurrent::mapped(result.stale, scanFile));
+    });
+    auto data = priv->data;
+    auto root = data->root;
+    watcher->setFuture(QtConcurrent::run([data, root]() { return sweep(data, root); }));
+}
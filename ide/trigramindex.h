@@ -0,0 +1,76 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef TRIGRAMINDEX_H
+#define TRIGRAMINDEX_H
+
+#include <QObject>
+#include <QSet>
+#include <QVector>
+
+#include <memory>
+
+class QFileInfo;
+
+// Persistent index from every three byte sequence to the project files holding it,
+// narrows a text search down to the files that can match before scanning them
+class TrigramIndex : public QObject
+{
+    Q_OBJECT
+public:
+    struct Data;
+
+    // Read only view for search workers, keeps the data alive after the index moves on
+    class Lookup
+    {
+    public:
+        // False when the query has no usable trigram, every file must be scanned then
+        bool narrow(const QString& text, bool isRegex, bool caseSensitive);
+        // Files missing from the index or changed since it was built are always accepted
+        bool mayMatch(const QFileInfo& info) const;
+
+    private:
+        friend class TrigramIndex;
+        std::shared_ptr<Data> data;
+        QSet<int> candidates;
+        int limit{ 0 };
+        bool narrowed{ false };
+    };
+
+    explicit TrigramIndex(QObject *parent = nullptr);
+    virtual ~TrigramIndex() override;
+
+    QString root() const;
+    Lookup lookup() const;
+
+    static QVector<quint32> fileTrigrams(const QByteArray& text);
+    static QVector<quint32> queryTrigrams(const QString& text, bool isRegex, bool caseSensitive);
+
+signals:
+    void updated(int files);
+
+public slots:
+    void setRoot(const QString& path);
+    void refresh();
+
+private:
+    class Priv_t;
+    std::unique_ptr<Priv_t> priv;
+};
+
+#endif // TRIGRAMINDEX_H
@@ -0,0 +1,394 @@
+/*
+ * This file is part of Embedded-IDE
+ *
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "usageindex.h"
+#include "wordindex.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+
+static const QStringList SOURCE_SUFFIXES = {
+    "c", "cpp", "h", "hpp", "cc", "hh", "hxx", "cxx", "c++", "h++", "inc", "s", "S",
+};
+
+static const QSet<QByteArray> KEYWORDS = {
+    "auto", "bool", "break", "case", "catch", "char", "class", "const", "constexpr", "continue",
+    "default", "defined", "delete", "do", "double", "else", "enum", "explicit", "extern", "false",
+    "float", "for", "friend", "goto", "if", "inline", "int", "long", "mutable", "namespace", "new",
+    "noexcept", "nullptr", "operator", "override", "private", "protected", "public", "register",
+    "return", "short", "signed", "sizeof", "static", "static_cast", "struct", "switch", "template",
+    "this", "throw", "true", "try", "typedef", "typename", "union", "unsigned", "using", "virtual",
+    "void", "volatile", "while",
+};
+
+static inline bool isIdentStart(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static inline bool isIdentChar(char c)
+{
+    return isIdentStart(c) || (c >= '0' && c <= '9');
+}
+
+static inline bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
+
+static void appendVarint(QByteArray& out, quint32 v)
+{
+    while (v >= 0x80) {
+        out.append(char((v & 0x7F) | 0x80));
+        v >>= 7;
+    }
+    out.append(char(v));
+}
+
+static quint32 readVarint(const char *&p)
+{
+    quint32 v = 0;
+    int shift = 0;
+    quint8 b;
+    do {
+        b = quint8(*p++);
+        v |= quint32(b & 0x7F) << shift;
+        shift += 7;
+    } while (b & 0x80);
+    return v;
+}
+
+static qint64 modifiedTime(const QString& path)
+{
+    return QFileInfo(path).lastModified().toMSecsSinceEpoch();
+}
+
+// Posting list layout, one block per file:
+//   varint fileId, varint payload size, payload
+// and each occurrence in the payload is
+//   varint line delta, varint (column << 2 | role)
+static QByteArray withoutFile(const QByteArray& list, int fileId)
+{
+    QByteArray out;
+    out.reserve(list.size());
+    const char *p = list.constData();
+    const char *end = p + list.size();
+    while (p < end) {
+        auto blockStart = p;
+        auto id = int(readVarint(p));
+        auto size = int(readVarint(p));
+        p += size;
+        if (id != fileId)
+            out.append(blockStart, int(p - blockStart));
+    }
+    return out;
+}
+
+// Each occurrence is two varints and only the last byte of a varint has the high bit clear
+static int occurrenceCount(const QByteArray& payload)
+{
+    int ends = 0;
+    for (auto c: payload)
+        if (!(quint8(c) & 0x80))
+            ends++;
+    return ends / 2;
+}
+
+struct PostingBuilder {
+    QByteArray data;
+    int lastLine{ 0 };
+};
+
+class UsageIndex::Priv_t
+{
+public:
+    QHash<QByteArray, int> symbolIds;
+    QVector<QByteArray> symbolNames;
+    QVector<QByteArray> postings;
+    QHash<QString, int> fileIds;
+    QStringList files;
+    QVector<QVector<int>> fileSymbols;
+    QVector<QVector<int>> fileSymbolCounts;
+    QVector<qint64> fileModified;
+    WordIndex words;
+
+    int fileId(const QString& path) {
+        auto it = fileIds.find(path);
+        if (it != fileIds.end())
+            return it.value();
+        int id = files.size();
+        files.append(path);
+        fileSymbols.append(QVector<int>());
+        fileSymbolCounts.append(QVector<int>());
+        fileModified.append(-1);
+        fileIds.insert(path, id);
+        return id;
+    }
+
+    int symbolId(const QByteArray& name) {
+        auto it = symbolIds.find(name);
+        if (it != symbolIds.end())
+            return it.value();
+        int id = postings.size();
+        postings.append(QByteArray());
+        symbolNames.append(name);
+        symbolIds.insert(name, id);
+        return id;
+    }
+
+    void dropFile(int id) {
+        const auto& symbols = fileSymbols.at(id);
+        for (int i = 0; i < symbols.size(); i++) {
+            auto sid = symbols.at(i);
+            postings[sid] = withoutFile(postings.at(sid), id);
+            words.add(symbolNames.at(sid), -fileSymbolCounts.at(id).at(i));
+        }
+        fileSymbols[id].clear();
+        fileSymbolCounts[id].clear();
+        fileModified[id] = -1;
+    }
+};
+
+UsageIndex::UsageIndex() :
+    priv(std::make_unique<Priv_t>())
+{
+}
+
+UsageIndex::~UsageIndex()
+{
+}
+
+QStringList UsageIndex::sourceFiles(const QString &projectPath)
+{
+    QStringList list;
+    QDirIterator it(projectPath, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        auto path = it.next();
+        if (isSourceFile(path))
+            list.append(path);
+    }
+    return list;
+}
+
+bool UsageIndex::isSourceFile(const QString &path)
+{
+    return SOURCE_SUFFIXES.contains(QFileInfo(path).suffix());
+}
+
+UsageIndex::FileUsages UsageIndex::scanFile(const QString &path)
+{
+    auto absolutePath = QDir::cleanPath(QFileInfo(path).absoluteFilePath());
+    QFile f(absolutePath);
+    if (!f.open(QFile::ReadOnly))
+        return FileUsages{ absolutePath, -1, {} };
+    auto usages = scan(absolutePath, f.readAll());
+    usages.modified = modifiedTime(absolutePath);
+    return usages;
+}
+
+UsageIndex::FileUsages UsageIndex::scan(const QString &path, const QByteArray &text)
+{
+    QHash<QByteArray, PostingBuilder> builders;
+    const char *s = text.constData();
+    const int n = text.size();
+    int line = 1;
+    int lineStart = 0;
+    bool onlyBlanks = true;
+    bool nextIsDefinition = false;
+
+    auto newLine = [&](int next) {
+        line++;
+        lineStart = next;
+        onlyBlanks = true;
+    };
+    auto record = [&](int start, int end, Role role) {
+        auto raw = QByteArray::fromRawData(s + start, end - start);
+        auto it = builders.find(raw);
+        if (it == builders.end())
+            it = builders.insert(QByteArray(s + start, end - start), PostingBuilder());
+        appendVarint(it->data, quint32(line - it->lastLine));
+        appendVarint(it->data, quint32(start - lineStart) << 2 | quint32(role));
+        it->lastLine = line;
+    };
+
+    for (int i = 0; i < n;) {
+        char c = s[i];
+        if (c == '\n') {
+            nextIsDefinition = false;
+            newLine(++i);
+        } else if (isBlank(c)) {
+            i++;
+        } else if (c == '\\' && i + 1 < n && s[i + 1] == '\n') {
+            i += 2;
+            line++;
+            lineStart = i;
+        } else if (c == '/' && i + 1 < n && s[i + 1] == '/') {
+            while (i < n && s[i] != '\n')
+                i++;
+        } else if (c == '/' && i + 1 < n && s[i + 1] == '*') {
+            for (i += 2; i < n && !(s[i] == '*' && i + 1 < n && s[i + 1] == '/'); i++)
+                if (s[i] == '\n')
+                    newLine(i + 1);
+            i += 2;
+        } else if (c == '"' || c == '\'') {
+            for (i++; i < n && s[i] != c && s[i] != '\n'; i++) {
+                if (s[i] == '\\' && i + 1 < n) {
+                    if (s[++i] == '\n')
+                        newLine(i + 1);
+                }
+            }
+            if (i < n && s[i] == c)
+                i++;
+            onlyBlanks = false;
+        } else if (c == '#' && onlyBlanks) {
+            for (i++; i < n && isBlank(s[i]); i++) {}
+            int start = i;
+            while (i < n && isIdentChar(s[i]))
+                i++;
+            auto directive = QByteArray::fromRawData(s + start, i - start);
+            if (directive == "define") {
+                nextIsDefinition = true;
+            } else if (directive == "include" || directive == "error" ||
+                       directive == "warning" || directive == "pragma") {
+                // Header names and free text, nothing to index
+                while (i < n && s[i] != '\n')
+                    i++;
+            }
+            onlyBlanks = false;
+        } else if (isIdentStart(c)) {
+            int start = i;
+            while (i < n && isIdentChar(s[i]))
+                i++;
+            if (!KEYWORDS.contains(QByteArray::fromRawData(s + start, i - start))) {
+                auto role = Role::Reference;
+                if (nextIsDefinition) {
+                    role = Role::Definition;
+                } else {
+                    int j = i;
+                    while (j < n && isBlank(s[j]))
+                        j++;
+                    if (j < n && s[j] == '(')
+                        role = Role::Call;
+                }
+                record(start, i, role);
+            }
+            nextIsDefinition = false;
+            onlyBlanks = false;
+        } else if (c >= '0' && c <= '9') {
+            // pp-number, so suffixes like 0x10UL do not look like identifiers
+            while (i < n && (isIdentChar(s[i]) || s[i] == '.'))
+                i++;
+            onlyBlanks = false;
+        } else {
+            onlyBlanks = false;
+            i++;
+        }
+    }
+
+    FileUsages usages{ path, -1, {} };
+    usages.postings.reserve(builders.size());
+    for (auto it = builders.begin(); it != builders.end(); ++it)
+        usages.postings.insert(it.key(), it->data);
+    return usages;
+}
+
+bool UsageIndex::isUpToDate(const QString &path) const
+{
+    auto it = priv->fileIds.find(path);
+    return it != priv->fileIds.end() && priv->fileModified.at(it.value()) == modifiedTime(path);
+}
+
+void UsageIndex::merge(const UsageIndex::FileUsages &usages)
+{
+    if (usages.modified == -1)
+        return;
+    int fid = priv->fileId(usages.path);
+    // A whole project scan may deliver a file after a newer per file update
+    if (priv->fileModified.at(fid) > usages.modified)
+        return;
+    priv->dropFile(fid);
+    auto& symbols = priv->fileSymbols[fid];
+    auto& counts = priv->fileSymbolCounts[fid];
+    symbols.reserve(usages.postings.size());
+    counts.reserve(usages.postings.size());
+    for (auto it = usages.postings.begin(); it != usages.postings.end(); ++it) {
+        int sid = priv->symbolId(it.key());
+        auto& list = priv->postings[sid];
+        appendVarint(list, quint32(fid));
+        appendVarint(list, quint32(it->size()));
+        list.append(it.value());
+        symbols.append(sid);
+        counts.append(occurrenceCount(it.value()));
+        priv->words.add(it.key(), counts.last());
+    }
+    priv->fileModified[fid] = usages.modified;
+}
+
+void UsageIndex::remove(const QString &path)
+{
+    auto it = priv->fileIds.find(path);
+    if (it != priv->fileIds.end())
+        priv->dropFile(it.value());
+}
+
+void UsageIndex::clear()
+{
+    priv = std::make_unique<Priv_t>();
+}
+
+UsageIndex::UsageList UsageIndex::find(const QByteArray &identifier) const
+{
+    UsageList list;
+    auto sid = priv->symbolIds.find(identifier);
+    if (sid == priv->symbolIds.end())
+        return list;
+    const auto& postings = priv->postings.at(sid.value());
+    const char *p = postings.constData();
+    const char *end = p + postings.size();
+    while (p < end) {
+        const auto& path = priv->files.at(int(readVarint(p)));
+        auto size = readVarint(p);
+        auto blockEnd = p + size;
+        int line = 0;
+        while (p < blockEnd) {
+            line += int(readVarint(p));
+            auto v = readVarint(p);
+            list.append(Usage{ path, line, int(v >> 2), Role(v & 3) });
+        }
+    }
+    return list;
+}
+
+QStringList UsageIndex::complete(const QByteArray &prefix, int limit) const
+{
+    return priv->words.complete(prefix, limit);
+}
+
+int UsageIndex::fileCount() const
+{
+    return priv->fileIds.size();
+}
+
+int UsageIndex::symbolCount() const
+{
+    return priv->symbolIds.size();
+}
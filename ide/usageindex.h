@@ -0,0 +1,72 @@
+/*
+ * This file is part of Embedded-IDE
+ *
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef USAGEINDEX_H
+#define USAGEINDEX_H
+
+#include <QHash>
+#include <QStringList>
+#include <QVector>
+
+#include <memory>
+
+class UsageIndex
+{
+public:
+    enum class Role { Reference = 0, Call = 1, Definition = 2 };
+
+    struct Usage {
+        QString path;
+        int line; // 1 based, same as ctags
+        int column;
+        Role role;
+    };
+    using UsageList = QVector<Usage>;
+
+    // Occurrences of one file, encoded per identifier and ready to merge
+    struct FileUsages {
+        QString path;
+        qint64 modified{ -1 };
+        QHash<QByteArray, QByteArray> postings;
+    };
+
+    UsageIndex();
+    ~UsageIndex();
+
+    static QStringList sourceFiles(const QString& projectPath);
+    static bool isSourceFile(const QString& path);
+    static FileUsages scanFile(const QString& path);
+    static FileUsages scan(const QString& path, const QByteArray& text);
+
+    bool isUpToDate(const QString& path) const;
+    void merge(const FileUsages& usages);
+    void remove(const QString& path);
+    void clear();
+
+    UsageList find(const QByteArray& identifier) const;
+    // Identifiers starting with prefix, the most used across the project first
+    QStringList complete(const QByteArray& prefix, int limit) const;
+    int fileCount() const;
+    int symbolCount() const;
+
+private:
+    class Priv_t;
+    std::unique_ptr<Priv_t> priv;
+};
+
+#endif // USAGEINDEX_H
@@ -0,0 +1,141 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "wordindex.h"
+
+#include <queue>
+
+static int commonPrefix(const QByteArray& a, const char *b, int size)
+{
+    int n = qMin(a.size(), size);
+    int i = 0;
+    while (i < n && a.at(i) == b[i])
+        i++;
+    return i;
+}
+
+int WordIndex::childStartingWith(int node, char c) const
+{
+    for (auto child: nodes.at(node).children)
+        if (nodes.at(child).edge.at(0) == c)
+            return child;
+    return -1;
+}
+
+void WordIndex::add(const QByteArray &word, int count)
+{
+    if (word.isEmpty() || count == 0)
+        return;
+    if (nodes.isEmpty())
+        nodes.append(Node());
+    QVector<int> path{ 0 };
+    int node = 0;
+    int i = 0;
+    while (i < word.size()) {
+        int child = childStartingWith(node, word.at(i));
+        if (child == -1) {
+            if (count < 0)
+                return;
+            child = nodes.size();
+            nodes.append(Node{ word.mid(i), 0, 0, {} });
+            nodes[node].children.append(child);
+            path.append(child);
+            node = child;
+            break;
+        }
+        int common = commonPrefix(nodes.at(child).edge, word.constData() + i, word.size() - i);
+        if (common < nodes.at(child).edge.size()) {
+            if (count < 0)
+                return;
+            // Split the edge so the word ends or forks on a node of its own
+            int middle = nodes.size();
+            nodes.append(Node{ nodes.at(child).edge.left(common), 0, nodes.at(child).best, { child } });
+            nodes[child].edge.remove(0, common);
+            auto& siblings = nodes[node].children;
+            siblings[siblings.indexOf(child)] = middle;
+            child = middle;
+        }
+        path.append(child);
+        node = child;
+        i += common;
+    }
+    nodes[node].count = qMax(0, nodes.at(node).count + count);
+    for (int k = path.size() - 1; k >= 0; k--) {
+        auto& n = nodes[path.at(k)];
+        int best = n.count;
+        for (auto child: n.children)
+            best = qMax(best, nodes.at(child).best);
+        n.best = best;
+    }
+}
+
+QStringList WordIndex::complete(const QByteArray &prefix, int limit) const
+{
+    QStringList words;
+    if (nodes.isEmpty())
+        return words;
+    int node = 0;
+    QByteArray text;
+    int i = 0;
+    while (i < prefix.size()) {
+        int child = childStartingWith(node, prefix.at(i));
+        if (child == -1)
+            return words;
+        const auto& edge = nodes.at(child).edge;
+        int common = commonPrefix(edge, prefix.constData() + i, prefix.size() - i);
+        if (common < edge.size() && i + common < prefix.size())
+            return words;
+        text += edge;
+        node = child;
+        i += common;
+    }
+
+    // Best first walk, a node is worth its most frequent word and a word its own count
+    struct Entry {
+        int key;
+        bool isWord;
+        int node;
+        QByteArray text;
+        bool operator <(const Entry& other) const {
+            if (key != other.key)
+                return key < other.key;
+            // Expand nodes before words of the same count so ties come out sorted
+            if (isWord != other.isWord)
+                return isWord;
+            return text > other.text;
+        }
+    };
+    std::priority_queue<Entry> queue;
+    if (nodes.at(node).best > 0)
+        queue.push(Entry{ nodes.at(node).best, false, node, text });
+    while (!queue.empty() && words.size() < limit) {
+        auto e = queue.top();
+        queue.pop();
+        if (e.isWord) {
+            words.append(QString::fromUtf8(e.text));
+            continue;
+        }
+        const auto& n = nodes.at(e.node);
+        if (n.count > 0)
+            queue.push(Entry{ n.count, true, e.node, e.text });
+        for (auto child: n.children)
+            if (nodes.at(child).best > 0)
+                queue.push(Entry{ nodes.at(child).best, false, child, e.text + nodes.at(child).edge });
+    }
+    return words;
+}
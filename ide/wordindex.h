@@ -0,0 +1,49 @@
+/*
+ * This file is part of Embedded-IDE
+ * 
+ * Copyright 2019 Martin Ribelotta <martinribelotta@gmail.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef WORDINDEX_H
+#define WORDINDEX_H
+
+#include <QByteArray>
+#include <QStringList>
+#include <QVector>
+
+// Radix tree of words with their occurrence count, every node also keeps the highest
+// count below it so the most frequent completions of a prefix come out first
+class WordIndex
+{
+public:
+    // Negative counts take occurrences away, words reaching zero are no longer completed
+    void add(const QByteArray& word, int count);
+    QStringList complete(const QByteArray& prefix, int limit) const;
+    void clear() { nodes.clear(); }
+
+private:
+    struct Node {
+        QByteArray edge;
+        int count{ 0 };
+        int best{ 0 };
+        QVector<int> children;
+    };
+
+    int childStartingWith(int node, char c) const;
+
+    QVector<Node> nodes;
+};
+
+#endif // WORDINDEX_H